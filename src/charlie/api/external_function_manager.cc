@@ -34,39 +34,90 @@ namespace charlie::api {
 
 using std::function;
 using std::list;
-using std::make_pair;
 using std::string;
 
 using program::FunctionDeclaration;
 using program::VariableDeclaration;
 
-ExternalFunctionManager::ExternalFunctionManager()
-    : id_(0), pointers_v_v_(), pointers_v_i_(), pointers_v_ccp_(), decs_() {}
-void ExternalFunctionManager::AddFunction(string funcName, function<void(void)> funcPointer) {
-  list<VariableDeclaration> args;
-  auto dec = FunctionDeclaration(funcName, VariableDeclaration::Void, args);
+namespace {
+// Pushes a resolved result onto the ALU stack. Returns the unresolved result or null.
+std::shared_ptr<PendingResult> complete(std::shared_ptr<PendingResult> result, vm::Stack* call_stack) {
+  // A function without result behaves like one which resolves to 0
+  if (result == nullptr || result->IsResolved()) {
+    call_stack->push(result != nullptr ? result->GetValue() : 0);
+    return nullptr;
+  }
+  return result;
+}
+
+int pop(vm::Stack* call_stack) {
+  int i = call_stack->top();
+  call_stack->pop();
+  return i;
+}
+
+// Trampolines of the supported signatures. "host" points to the std::function of the signature.
+std::shared_ptr<PendingResult> call_void(void const* host, vm::Stack*) {
+  (*static_cast<function<void(void)> const*>(host))();
+  return nullptr;
+}
+std::shared_ptr<PendingResult> call_int(void const* host, vm::Stack* call_stack) {
+  (*static_cast<function<void(int)> const*>(host))(pop(call_stack));
+  return nullptr;
+}
+std::shared_ptr<PendingResult> call_string(void const* host, vm::Stack* call_stack) {
+  (*static_cast<function<void(const char*)> const*>(host))(reinterpret_cast<const char*>(pop(call_stack)));
+  return nullptr;
+}
+std::shared_ptr<PendingResult> call_async_void(void const* host, vm::Stack* call_stack) {
+  return complete((*static_cast<function<std::shared_ptr<PendingResult>(void)> const*>(host))(), call_stack);
+}
+std::shared_ptr<PendingResult> call_async_int(void const* host, vm::Stack* call_stack) {
+  auto const& async = *static_cast<function<std::shared_ptr<PendingResult>(int)> const*>(host);
+  return complete(async(pop(call_stack)), call_stack);
+}
+}  // namespace
 
-  int id = id_++;
+ExternalFunctionManager::ExternalFunctionManager() : entries_(), decs_() {}
+
+int ExternalFunctionManager::add(FunctionDeclaration const& dec, Trampoline trampoline,
+                                 std::shared_ptr<void const> function) {
+  int id = static_cast<int>(entries_.size());
   decs_[dec] = id;
-  pointers_v_v_.insert(make_pair(id, FunctionInfo<void(void)>(funcPointer, dec)));
+  entries_.push_back(
+      {trampoline, std::move(function), dec.image_type, static_cast<int>(dec.argument_types.size())});
+  return id;
+}
+
+void ExternalFunctionManager::AddFunction(string funcName, function<void(void)> funcPointer) {
+  list<VariableDeclaration> args;
+  add(FunctionDeclaration(funcName, VariableDeclaration::Void, args), call_void,
+      std::make_shared<function<void(void)>>(std::move(funcPointer)));
 }
 void ExternalFunctionManager::AddFunction(string funcName, function<void(int)> funcPointer) {
   list<VariableDeclaration> args;
   args.push_back(VariableDeclaration(VariableDeclaration::Int));
-  auto dec = FunctionDeclaration(funcName, VariableDeclaration::Void, args);
-
-  int id = id_++;
-  decs_[dec] = id;
-  pointers_v_i_.insert(make_pair(id, FunctionInfo<void(int)>(funcPointer, dec)));
+  add(FunctionDeclaration(funcName, VariableDeclaration::Void, args), call_int,
+      std::make_shared<function<void(int)>>(std::move(funcPointer)));
 }
 void ExternalFunctionManager::AddFunction(string funcName, function<void(const char*)> funcPointer) {
   list<VariableDeclaration> args;
   args.push_back(VariableDeclaration(VariableDeclaration::ConstCharPointer));
-  auto dec = FunctionDeclaration(funcName, VariableDeclaration::Void, args);
-
-  int id = id_++;
-  decs_[dec] = id;
-  pointers_v_ccp_.insert(make_pair(id, FunctionInfo<void(const char*)>(funcPointer, dec)));
+  add(FunctionDeclaration(funcName, VariableDeclaration::Void, args), call_string,
+      std::make_shared<function<void(const char*)>>(std::move(funcPointer)));
+}
+void ExternalFunctionManager::AddAsyncFunction(string funcName,
+                                               function<std::shared_ptr<PendingResult>(void)> funcPointer) {
+  list<VariableDeclaration> args;
+  add(FunctionDeclaration(funcName, VariableDeclaration::Int, args), call_async_void,
+      std::make_shared<function<std::shared_ptr<PendingResult>(void)>>(std::move(funcPointer)));
+}
+void ExternalFunctionManager::AddAsyncFunction(string funcName,
+                                               function<std::shared_ptr<PendingResult>(int)> funcPointer) {
+  list<VariableDeclaration> args;
+  args.push_back(VariableDeclaration(VariableDeclaration::Int));
+  add(FunctionDeclaration(funcName, VariableDeclaration::Int, args), call_async_int,
+      std::make_shared<function<std::shared_ptr<PendingResult>(int)>>(std::move(funcPointer)));
 }
 
 int ExternalFunctionManager::GetId(FunctionDeclaration const& dec) const {
@@ -75,25 +126,14 @@ int ExternalFunctionManager::GetId(FunctionDeclaration const& dec) const {
   return it->second;
 }
 
-void ExternalFunctionManager::Invoke(int id, std::stack<int>* call_stack) const {
-  auto it_v_v = pointers_v_v_.find(id);
-  if (it_v_v != pointers_v_v_.end()) {
-    it_v_v->second.pointer();
-    return;
-  }
-  auto it_v_i = pointers_v_i_.find(id);
-  if (it_v_i != pointers_v_i_.end()) {
-    int i = call_stack->top();
-    call_stack->pop();
-    it_v_i->second.pointer(i);
-    return;
-  }
-  auto it_v_cpp = pointers_v_ccp_.find(id);
-  if (it_v_cpp != pointers_v_ccp_.end()) {
-    int i = call_stack->top();
-    call_stack->pop();
-    it_v_cpp->second.pointer(reinterpret_cast<const char*>(i));
-    return;
-  }
+VariableDeclaration::TypeEnum ExternalFunctionManager::GetImageType(int id) const {
+  if (id < 0 || id >= static_cast<int>(entries_.size())) return VariableDeclaration::Void;
+  return entries_[id].image_type;
+}
+
+int ExternalFunctionManager::GetArgumentCount(int id) const {
+  if (id < 0 || id >= static_cast<int>(entries_.size())) return -1;
+  return entries_[id].argument_count;
 }
+
 }  // namespace charlie::api
\ No newline at end of file
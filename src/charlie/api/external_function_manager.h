@@ -31,14 +31,19 @@
 #include <map>
 #include <set>
 #include <string>
-#include <stack>
 #include <list>
 #include <functional>
+#include <memory>
+#include <vector>
 
 #include "../common/exportDefs.h"
 
+#include "pending_result.h"
+
 #include "../program/function_declaration.h"
 
+#include "../vm/stack.h"
+
 namespace charlie {
 namespace api {
 // Registrates external functions to compiler and VM.
@@ -46,15 +51,17 @@ namespace api {
 // Note: registrate the function in the same order when compiling and running the code.
 //  Example:
 //      auto manager = ExternalFunctionManager();
-//      manager.Add("print", [](int message){
+//      manager.AddFunction("print", [](int message){
 //        std::cout << message;
 //      });
 //
 //      std::list<VariableDeclaration> arguments = { VariableDeclaration(VariableDeclaration::TypeEnum::Int) };
-//      int id = manager.GetId(FunctionDec("print", VariableDeclaration::TypeEnum::Void, arguments));
+//      int id = manager.GetId(FunctionDeclaration("print", VariableDeclaration::TypeEnum::Void, arguments));
 //
-//      std::list<int> call_stack = {123};
-//      manager.Invoke(0, call_stack);          // Prints the integer 123 to the console
+//      vm::Stack call_stack;
+//      call_stack.push(123);
+//      auto pending = manager.Invoke(id, &call_stack);   // Prints the integer 123 to the console
+//      // "pending" is null: Only asynchronous functions return a result which is not resolved yet
 class ExternalFunctionManager {
  public:
   // Creates the empty manager
@@ -63,28 +70,42 @@ class ExternalFunctionManager {
   xprt void AddFunction(std::string funcName, std::function<void(void)> funcPointer);
   xprt void AddFunction(std::string funcName, std::function<void(int)> funcPointer);
   xprt void AddFunction(std::string funcName, std::function<void(const char*)> funcPointer);
+  // Adds a function whose int image arrives later. See PendingResult.
+  xprt void AddAsyncFunction(std::string funcName, std::function<std::shared_ptr<PendingResult>(void)> funcPointer);
+  xprt void AddAsyncFunction(std::string funcName, std::function<std::shared_ptr<PendingResult>(int)> funcPointer);
   // Returns the id of the specified function declaration if found. Otherwise returns -1.
   xprt int GetId(program::FunctionDeclaration const& dec) const;
-  // Invokes the function with the specified id. The arguments are stored in "call_stack"
-  xprt void Invoke(int id, std::stack<int> *call_stack) const;
+  // Returns the number of arguments the function with the specified id pops from the ALU stack or -1 if not found.
+  xprt int GetArgumentCount(int id) const;
+  // Returns the image type of the function with the specified id. Void if not found.
+  xprt program::VariableDeclaration::TypeEnum GetImageType(int id) const;
+  // Invokes the function with the specified id. The arguments are stored in "call_stack".
+  // The image gets pushed onto "call_stack" once it is available. Returns the result of an asynchronous function which
+  // is not resolved yet, otherwise null.
+  std::shared_ptr<PendingResult> Invoke(int id, vm::Stack *call_stack) const {
+    if (id < 0 || id >= static_cast<int>(entries_.size())) return nullptr;
+    auto const &entry = entries_[id];
+    return entry.trampoline(entry.function.get(), call_stack);
+  }
 
  private:
-  // Stores all relevant informations of a function registration
-  template<class _Fty>
-  struct FunctionInfo {
-    FunctionInfo(std::function<_Fty> const& pointer, program::FunctionDeclaration const& declaration) :
-      pointer(pointer), declaration(declaration) {}
-    std::function<_Fty> pointer;
-    program::FunctionDeclaration declaration;
+  // Pops the arguments of the function from the ALU stack and calls the host function "host" points to.
+  // Returns the unresolved result or null.
+  typedef std::shared_ptr<PendingResult> (*Trampoline)(void const *host, vm::Stack *call_stack);
+  // A registrated function and its metadata
+  struct Entry {
+    Trampoline trampoline;
+    // The std::function passed by the host. Shared by the copies of the manager.
+    std::shared_ptr<void const> function;
+    program::VariableDeclaration::TypeEnum image_type;
+    int argument_count;
   };
-  // Saves the function pointers to corresponing id for each function signature
-  std::map<int, FunctionInfo<void(void)>> pointers_v_v_;
-  std::map<int, FunctionInfo<void(int)>> pointers_v_i_;
-  std::map<int, FunctionInfo<void(const char*)>> pointers_v_ccp_;
+  // Registers the declaration and returns the id of the new function
+  int add(program::FunctionDeclaration const &dec, Trampoline trampoline, std::shared_ptr<void const> function);
+  // Registrated functions indexed by their id
+  std::vector<Entry> entries_;
   // This map is used to get the id of an registrated function by its declaration
   std::map<program::FunctionDeclaration, int, program::FunctionDeclaration::comparer> decs_;
-  // Counter of the ids assigned to the registrated funtion pointers
-  int id_;
 };
 }  // namespace api
 }  // namespace charlie
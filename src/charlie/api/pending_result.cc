@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "pending_result.h"
+
+#include <utility>
+
+namespace charlie::api {
+
+PendingResult::PendingResult() : mutex_(), resolved_signal_(), resolved_(false), value_(0), callbacks_() {}
+
+void PendingResult::Resolve(int value) {
+  std::vector<std::function<void()>> callbacks;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (resolved_) return;
+    resolved_ = true;
+    value_ = value;
+    callbacks.swap(callbacks_);
+  }
+  resolved_signal_.notify_all();
+  // Outside of the lock: The callbacks may resume the programs on this thread
+  for (auto &callback : callbacks) callback();
+}
+
+bool PendingResult::IsResolved() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return resolved_;
+}
+
+int PendingResult::GetValue() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return value_;
+}
+
+void PendingResult::Wait() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  resolved_signal_.wait(lock, [this]() { return resolved_; });
+}
+
+void PendingResult::OnResolved(std::function<void()> callback) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!resolved_) {
+      callbacks_.push_back(std::move(callback));
+      return;
+    }
+  }
+  callback();
+}
+
+}  // namespace charlie::api
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef CHARLIE_API_PENDING_RESULT_H_
+#define CHARLIE_API_PENDING_RESULT_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "../common/exportDefs.h"
+
+namespace charlie {
+namespace api {
+// Image of an asynchronous external function which arrives later.
+// The host function returns it right away and resolves it from any thread once the value is available. Meanwhile the
+// calling program is parked and the thread which ran it is free to run other programs.
+//  Example:
+//      manager.AddAsyncFunction("lookup", [&service](int key) {
+//        auto result = std::make_shared<PendingResult>();
+//        service.Request(key, [result](int value) { result->Resolve(value); });
+//        return result;
+//      });
+class PendingResult {
+ public:
+  xprt PendingResult();
+  // Sets the value and calls the callbacks registered with OnResolved. Only the first call has an effect.
+  xprt void Resolve(int value);
+  // Returns true once the value has been set.
+  xprt bool IsResolved() const;
+  // Returns the value. Must not be called before the result is resolved.
+  xprt int GetValue() const;
+  // Blocks until the value has been set.
+  xprt void Wait() const;
+  // Calls "callback" on the resolving thread once the value has been set, or right away if it already is.
+  // Several programs may wait for the same result, e.g. if the host caches it. Each of them registers a callback.
+  xprt void OnResolved(std::function<void()> callback);
+
+ private:
+  mutable std::mutex mutex_;
+  mutable std::condition_variable resolved_signal_;
+  bool resolved_;
+  int value_;
+  std::vector<std::function<void()>> callbacks_;
+};
+}  // namespace api
+}  // namespace charlie
+
+#endif  // !CHARLIE_API_PENDING_RESULT_H_
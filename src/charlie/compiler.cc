@@ -29,17 +29,32 @@
 
 #include <assert.h>
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <list>
+#include <mutex>
+#include <set>
 #include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "scanner.h"
 
 #include "common/definitions.h"
 #include "common/io.h"
 
+#include "program/constant_folding.h"
+#include "program/dead_code.h"
+#include "program/ir/builder.h"
+#include "program/ir/passes.h"
+#include "program/ir/registers.h"
 #include "program/mapping.h"
+#include "program/peephole.h"
 
 #include "vm/instruction.h"
+#include "vm/runtime.h"
 
 #define ERROR_MESSAGE_MAKE_CODE(message) error_message(message, __FILE__, __LINE__)
 #define ERROR_MESSAGE_WITH_POS_MAKE_CODE(message, pos) error_message_to_code(message, pos, __FILE__, __LINE__)
@@ -71,6 +86,69 @@ using token::ControlFlow;
 using token::Label;
 using token::Operator;
 
+namespace {
+// Gets the register address of a variable or the value of an integer constant.
+// Returns false if the statement is something else.
+bool register_operand(Statement const& statement, bool* constant, int* operand) {
+  if (statement.value == nullptr || !statement.arguments.empty()) return false;
+  if (statement.value->token_type == Base::TokenTypeEnum::ConstantInt) {
+    *constant = true;
+    *operand = statement.value->ByteCode();
+    return true;
+  }
+  if (statement.value->token_type == Base::TokenTypeEnum::Label) {
+    auto label = dynamic_cast<Label*>(statement.value);
+    if (label->kind != Label::KindEnum::Variable) return false;
+    *constant = false;
+    *operand = label->register_address();
+    return *operand > -1;
+  }
+  return false;
+}
+
+int frame_size_of(program::Scope const& scope);
+
+// Gets the number of register slots the blocks within the statement need at most.
+int nested_frame_size(Statement const& statement) {
+  int size = statement.block != nullptr ? frame_size_of(*statement.block) : 0;
+  for (auto const& argument : statement.arguments) size = std::max(size, nested_frame_size(argument));
+  return size;
+}
+
+// Whether the function neither accesses global variables nor calls other functions than the pure ones.
+// Divisions by values which may be 0 or -1 trap, also when evaluating the function during the build.
+bool is_pure(program::ir::Function const& function, std::function<bool(int function)> const& pure) {
+  for (auto const& block : function.blocks) {
+    for (auto const& instruction : block.instructions) {
+      switch (instruction.opcode) {
+        case program::ir::Opcode::Load:
+        case program::ir::Opcode::Store:
+        case program::ir::Opcode::CallEx:
+          return false;
+        case program::ir::Opcode::Divide:
+        case program::ir::Opcode::Modulo:
+          if (instruction.HasSideEffects()) return false;
+          break;
+        case program::ir::Opcode::Call:
+          if (!pure(instruction.immediate)) return false;
+          break;
+        default:
+          break;
+      }
+    }
+  }
+  return true;
+}
+
+// Gets the number of register slots the variables of the scope and of its nested blocks need.
+// Nested blocks get placed behind their parent, so sibling blocks share their slots.
+int frame_size_of(program::Scope const& scope) {
+  int nested = 0;
+  for (auto const& statement : scope.statements) nested = std::max(nested, nested_frame_size(statement));
+  return scope.num_variable_declarations + nested;
+}
+}  // namespace
+
 void write_scope_to_mapping(program::Scope const& scope, int begin, int end,
                             std::shared_ptr<program::Mapping> mapping) {
   auto scope_mapping = std::make_unique<program::Mapping::Scope>();
@@ -87,10 +165,122 @@ void write_scope_to_mapping(program::Scope const& scope, int begin, int end,
   mapping->Scopes.push_back(std::move(scope_mapping));
 }
 
-Compiler::Compiler() : LoggingComponent(), external_function_manager(), program_() {}
+// The units get compiled in parallel and linked afterwards. Until then the targets of calls hold the index of the
+// called function and the targets of jumps are relative to the begin of the unit.
+class Compiler::Unit : public common::LoggingComponent {
+ public:
+  // "index": Index of the function or -1 for the code outside of all functions
+  Unit(Compiler* compiler, int index, bool sourcemaps);
+  // Compiles the function. The error messages are kept in "messages".
+  bool Compile(FunctionDeclaration const& declaration, bool sourcemaps);
+  // Compiles the code outside of all functions: The global variables and the call of the main function, whose index
+  // is the last call target.
+  bool CompileRoot(bool sourcemaps);
+  inline int index() const { return index_; }
+  // Like the program, the code starts with a placeholder in front of the address 0
+  std::vector<int> instructions;
+  // Positions of the call targets in "instructions"
+  std::vector<int> calls;
+  // Positions of the jump targets in "instructions"
+  std::vector<int> jumps;
+  // Maximum depth of the ALU stack, relative to the entry of the function.
+  int max_stack_depth;
+  // Whether the code can be copied to the call sites of the function
+  bool inlinable;
+  // Whether the function neither accesses global variables nor calls external functions
+  bool pure;
+  // Whether Compile succeeded
+  bool compiled;
+  // Set once Compile returned. Guarded by the mutex of the compiler.
+  bool finished;
+  // The addresses are relative to the begin of the unit. Null without source mapping.
+  std::shared_ptr<program::Mapping> mapping;
+  // The error messages of the compilation
+  std::vector<std::string> messages;
+  // The SSA form of the function if Options::ir_dump is set
+  std::string ir;
+
+ private:
+  // Enrolls a block of the syntax tree to bytecode.
+  bool enrollBlock(map<FunctionDeclaration, int, FunctionDeclaration::comparer> const& functionDict,
+                   program::Scope const& block, bool sourcemaps);
+  // Enrolls a statement of the syntax tree to bytecode.
+  // "tail": The statement is the value of a return statement. A call of a function reuses the frame of the current one.
+  bool enrollStatement(map<FunctionDeclaration, int, FunctionDeclaration::comparer> const& functionDict,
+                       Statement const& statement, bool sourcemaps, bool tail = false);
+  // Enrolls the condition of an if or while statement followed by a branch which is taken if it does not hold.
+  // "elseIndex": Index of the branch address in the unit, which has to be set by the caller.
+  bool enrollBranch(map<FunctionDeclaration, int, FunctionDeclaration::comparer> const& functionDict,
+                    Statement const& condition, bool sourcemaps, size_t* elseIndex);
+  // Enrolls a function in SSA form whose registers are assigned.
+  void enrollFunction(program::ir::Function const& function);
+  // Returns the unit of the function if its code gets copied to the call sites, otherwise nullptr.
+  // Waits until the function has been compiled.
+  Unit const* inline_callee(int function);
+  // Sets "inlinable" once the function has been enrolled.
+  void rememberInlinable();
+  // Copies the code of the function to the end of the unit. Its variables get moved behind the ones of the current
+  // function, whose frame grows accordingly.
+  void enrollInline(Unit const& callee);
+  // Enrolls an assignment of a variable or constant, or of an arithmetic operation on them as register instruction.
+  // Returns false if the value is not that simple, without emitting anything.
+  bool enrollRegisterAssignment(int address, Statement const& value);
+  // Appends the instruction to the code, tracks its effect on the ALU stack and remembers the position of its target.
+  void emit(int instruction);
+  void emit(int instruction, int operand);
+  void emit(int instruction, int operand, int operand2);
+  void emit(int instruction, int operand, int operand2, int operand3);
+  // Adds the change to the tracked ALU stack depth of the current function.
+  void track_stack(int change);
+  Compiler* compiler_;
+  Options const& options_;
+  const int index_;
+  // Number of global variables
+  const int globals_;
+  // ALU stack depth after the code enrolled so far, relative to the entry of the current function.
+  int stack_depth_;
+  // Number of register slots the variables of the current function need, including the ones of its nested blocks.
+  int frame_size_;
+  // Number of register slots the frame of the current function needs, including the variables of inlined functions.
+  int frame_extent_;
+  // Whether the code enrolled last does not continue, e.g. a return statement. Following statements get skipped.
+  bool unreachable_;
+};
+
+Compiler::Options::Options()
+    : register_instructions(true),
+      fold_constants(true),
+      peephole(true),
+      inline_size(32),
+      ssa(true),
+      ir_dump(nullptr),
+      evaluation_budget(1 << 16),
+      threads(0),
+      map_variables(true) {}
+
+Compiler::Compiler()
+    : LoggingComponent(),
+      external_function_manager(),
+      options(),
+      program_(),
+      functions_(),
+      units_(),
+      mutex_(),
+      finished_(),
+      evaluations_() {}
 
 Compiler::Compiler(function<void(string const& message)> messageDelegate)
-    : LoggingComponent(messageDelegate), external_function_manager(), program_() {}
+    : LoggingComponent(messageDelegate),
+      external_function_manager(),
+      options(),
+      program_(),
+      functions_(),
+      units_(),
+      mutex_(),
+      finished_(),
+      evaluations_() {}
+
+Compiler::~Compiler() = default;
 
 bool Compiler::Build(string const& filename, bool sourcemaps) {
   string code;
@@ -108,6 +298,7 @@ bool Compiler::Build(string const& filename, bool sourcemaps) {
     return false;
   }
   codeInfo_.set(&code);
+  if (options.fold_constants) program::FoldConstants(&program_);
   if (!compile(sourcemaps)) {
     error_message("Compiling failed!");
     return false;
@@ -127,91 +318,268 @@ bool Compiler::SaveProgram(std::string const& filename, bool binary, bool mappin
 
 bool Compiler::compile(bool sourcemaps) {
   if (sourcemaps) mapping_ = std::make_shared<program::Mapping>();
-  auto funcPositions = map<FunctionDeclaration, int, FunctionDeclaration::comparer>();
+  program_.max_stack_depth = 0;
+  functions_.clear();
+  units_.clear();
+  evaluations_.clear();
+  // Functions call the ones declared before them, the first of equal declarations gets called
+  std::vector<FunctionDeclaration const*> declarations;
+  for (auto const& declaration : program_.function_declarations) {
+    functions_.insert(make_pair(declaration, static_cast<int>(declarations.size())));
+    declarations.push_back(&declaration);
+  }
+  Unit root(this, -1, sourcemaps);
+  if (!root.CompileRoot(sourcemaps)) {
+    for (auto const& message : root.messages) error_message(message);
+    return false;
+  }
+  const int count = static_cast<int>(declarations.size());
+  for (int i = 0; i < count; ++i) units_.push_back(std::make_unique<Unit>(this, i, sourcemaps));
 
-  program_.instructions.push_back(BYTECODE_VERSION);
-  // Jump address will be inserted at the end
-  // Global variables
-  program_.instructions.push_back(InstructionEnums::IncreaseRegister);
-  program_.instructions.push_back(program_.root.num_variable_declarations);
-
-  for (auto itI = program_.root.statements.begin(); itI != program_.root.statements.end(); ++itI) {
-    if (!enrollStatement(funcPositions, *itI, sourcemaps)) return false;
-  }
-
-  program_.instructions.push_back(InstructionEnums::Call);
-  program_.instructions.push_back(0);  // Placeholder for the call of the main function
-  int itMainAddress = program_.instructions.size() - 1;
-  program_.instructions.push_back(InstructionEnums::Exit);
-  // Store function definitions
-  for (auto itF = program_.function_declarations.cbegin(); itF != program_.function_declarations.cend(); ++itF) {
-    int func_begin = program_.instructions.size() - 1;
-    if (!itF->has_definition) {
-      stringstream st;
-      st << "Missing defintion for function: " << (*itF);
-      ERROR_MESSAGE_MAKE_CODE(st);
-      return false;
-    }
-    funcPositions.insert(make_pair((*itF), program_.instructions.size() - 1));
-    if (!enrollBlock(funcPositions, itF->definition, sourcemaps)) return false;
-
-    program_.instructions.push_back(InstructionEnums::Return);
-    if (sourcemaps) {
-      auto fun_map = std::make_unique<program::Mapping::Function>(itF->label);
-      fun_map->scope.begin = func_begin;
-      fun_map->scope.end = program_.instructions.size() - 1;
-      mapping_->Functions.push_back(std::move(fun_map));
+  // The functions get taken in the order of their declarations. A unit only waits for the ones declared before it,
+  // which have been taken already.
+  std::atomic<int> next(0);
+  std::atomic<bool> failed(false);
+  auto worker = [&]() {
+    while (!failed) {
+      const int i = next++;
+      if (i >= count) break;
+      auto& unit = *units_[i];
+      if (!unit.Compile(*declarations[i], sourcemaps)) failed = true;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        unit.finished = true;
+      }
+      finished_.notify_all();
     }
+  };
+  int threads = options.threads;
+  if (threads < 1) threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  threads = std::min(threads, count);
+  std::vector<std::thread> workers;
+  for (int i = 1; i < threads; ++i) workers.emplace_back(worker);
+  worker();
+  for (auto& thread : workers) thread.join();
+
+  // Report in the order of the declarations as if the functions were compiled one after another
+  for (auto const& unit : units_) {
+    if (!unit->finished) return false;
+    if (options.ir_dump != nullptr) *options.ir_dump << unit->ir;
+    for (auto const& message : unit->messages) error_message(message);
+    if (!unit->compiled) return false;
+  }
+
+  // Find entryPoint
+  auto main = functions_.find(FunctionDeclaration(string("main"), VariableDeclaration::Int));
+  if (main == functions_.end()) {
+    ERROR_MESSAGE_MAKE_CODE("Can not find entry point");
+    return false;
   }
+  root.instructions[root.calls.back()] = main->second;
 
+  std::vector<Unit const*> units = {&root};
+  for (auto const& unit : units_) units.push_back(unit.get());
+  program_.instructions.push_back(BYTECODE_VERSION);
+  auto ranges = link(units, &program_.instructions);
   program_.instructions.push_back(InstructionEnums::DecreaseRegister);
+  for (auto unit : units) program_.max_stack_depth = std::max(program_.max_stack_depth, unit->max_stack_depth);
+
   if (sourcemaps) {
+    for (size_t i = 0; i < units.size(); ++i) {
+      const int begin = ranges[i].first;
+      for (auto const& instruction : units[i]->mapping->Instructions) {
+        mapping_->Instructions.insert({instruction.first + begin, instruction.second});
+      }
+      for (auto& scope : units[i]->mapping->Scopes) {
+        scope->begin += begin;
+        scope->end += begin;
+        mapping_->Scopes.push_back(std::move(scope));
+      }
+      if (i == 0) continue;
+      auto fun_map = std::make_unique<program::Mapping::Function>(declarations[i - 1]->label);
+      fun_map->scope.begin = begin;
+      fun_map->scope.end = ranges[i].second;
+      mapping_->Functions.push_back(std::move(fun_map));
+    }
     write_scope_to_mapping(program_.root, 1, program_.instructions.size() - 1, mapping_);
   }
 
-  // Find entryPoint
-  auto args = list<VariableDeclaration>();
-  args.push_back(VariableDeclaration::Int);
-  args.push_back(VariableDeclaration::Char);
-  auto main = funcPositions.find(FunctionDeclaration(string("main"), VariableDeclaration::Int));
-  if (main == funcPositions.end()) {
-    ERROR_MESSAGE_MAKE_CODE("Can not find entry point");
+  // E.g. functions which got inlined at all call sites
+  ranges.erase(ranges.begin());
+  program::RemoveUnusedFunctions(&program_, ranges, mapping_.get());
+  if (options.peephole) program::FuseInstructions(&program_, mapping_.get());
+  program_.Dispose();
+  units_.clear();
+  return true;
+}
+
+Compiler::Unit const& Compiler::finished(int index) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto const& unit = *units_.at(index);
+  finished_.wait(lock, [&unit]() { return unit.finished; });
+  return unit;
+}
+
+std::vector<std::pair<int, int>> Compiler::link(std::vector<Unit const*> const& units, std::vector<int>* bytecode) {
+  std::map<int, int> begins;
+  std::vector<std::pair<int, int>> ranges;
+  int address = static_cast<int>(bytecode->size()) - 1;
+  for (auto unit : units) {
+    const int size = static_cast<int>(unit->instructions.size()) - 1;
+    begins[unit->index()] = address;
+    ranges.push_back({address, address + size});
+    address += size;
+  }
+  for (size_t i = 0; i < units.size(); ++i) {
+    auto const& code = units[i]->instructions;
+    // Position of the address 0 of the unit
+    const int base = ranges[i].first;
+    bytecode->insert(bytecode->end(), code.begin() + 1, code.end());
+    for (auto position : units[i]->jumps) (*bytecode)[base + position] += base;
+    for (auto position : units[i]->calls) (*bytecode)[base + position] = begins.at(code[position]);
+  }
+  return ranges;
+}
+
+Compiler::Unit::Unit(Compiler* compiler, int index, bool sourcemaps)
+    : LoggingComponent([this](string const& message) { messages.push_back(message); }),
+      instructions({0}),
+      calls(),
+      jumps(),
+      max_stack_depth(0),
+      inlinable(false),
+      pure(false),
+      compiled(false),
+      finished(false),
+      mapping(sourcemaps ? std::make_shared<program::Mapping>() : nullptr),
+      messages(),
+      ir(),
+      compiler_(compiler),
+      options_(compiler->options),
+      index_(index),
+      globals_(compiler->program_.root.num_variable_declarations),
+      stack_depth_(0),
+      frame_size_(0),
+      frame_extent_(0),
+      unreachable_(false) {
+  codeInfo_ = compiler->codeInfo_;
+}
+
+bool Compiler::Unit::CompileRoot(bool sourcemaps) {
+  // Global variables
+  emit(InstructionEnums::IncreaseRegister, globals_);
+  for (auto const& statement : compiler_->program_.root.statements) {
+    if (!enrollStatement(compiler_->functions_, statement, sourcemaps)) return false;
+  }
+  const int depth = max_stack_depth;
+  // The index of the main function gets inserted when linking
+  emit(InstructionEnums::Call, -1);
+  emit(InstructionEnums::Exit);
+  max_stack_depth = depth;
+  compiled = true;
+  return true;
+}
+
+bool Compiler::Unit::Compile(FunctionDeclaration const& declaration, bool sourcemaps) {
+  if (!declaration.has_definition) {
+    stringstream st;
+    st << "Missing defintion for function: " << declaration;
+    ERROR_MESSAGE_MAKE_CODE(st);
     return false;
   }
+  // Calls in SSA form refer to the functions declared so far like the ones in the syntax tree
+  auto resolve = [this](FunctionDeclaration const& signature, program::ir::Callee* callee) {
+    const int id = compiler_->external_function_manager.GetId(signature);
+    if (id > -1) {
+      *callee = {true, id, compiler_->external_function_manager.GetImageType(id) != VariableDeclaration::Void};
+      return true;
+    }
+    auto it = compiler_->functions_.find(signature);
+    if (it == compiler_->functions_.end() || it->second > index_) return false;
+    *callee = {false, it->second, it->first.image_type != VariableDeclaration::Void};
+    return true;
+  };
+  // The mapping of the variables refers to their addresses in the syntax tree
+  std::unique_ptr<program::ir::Function> function;
+  if (options_.ssa && options_.register_instructions && !(sourcemaps && options_.map_variables))
+    function = program::ir::Build(declaration, globals_, resolve);
+  if (function != nullptr) {
+    auto passes = program::ir::PassManager::Default();
+    if (options_.evaluation_budget > 0) {
+      passes.Add(program::ir::CreateEvaluateCalls([this](int callee, std::vector<int> const& arguments, int* result) {
+        return callee != index_ && compiler_->finished(callee).pure &&
+               compiler_->evaluateCall(callee, arguments, result);
+      }));
+    }
+    passes.Run(function.get());
+    if (options_.evaluation_budget > 0) {
+      pure = is_pure(*function, [this](int callee) { return callee == index_ || compiler_->finished(callee).pure; });
+    }
+    program::ir::AssignRegisters(function.get(), globals_);
+    if (options_.ir_dump != nullptr) {
+      std::ostringstream dump;
+      dump << *function;
+      ir = dump.str();
+    }
+    frame_size_ = function->frame_size;
+  } else {
+    // One frame holds the variables of all blocks of the function, which therefore open no scopes themselves
+    frame_size_ = frame_size_of(declaration.definition);
+  }
+  frame_extent_ = frame_size_;
+  emit(InstructionEnums::IncreaseRegister, frame_size_);
+  const int frame_index = instructions.size() - 1;
+  if (function != nullptr) {
+    enrollFunction(*function);
+  } else if (!enrollBlock(compiler_->functions_, declaration.definition, sourcemaps)) {
+    return false;
+  }
+  // The variables of inlined functions are placed behind the ones of the function
+  instructions[frame_index] = frame_extent_;
 
-  program_.instructions[itMainAddress] = main->second;
-  program_.Dispose();
+  // Return closes the frame. Falling off the end of a function with an image returns 0, so that the result does not
+  // depend on the values of unused expressions left on the ALU stack.
+  if (!unreachable_) {
+    if (declaration.image_type != VariableDeclaration::Void) emit(InstructionEnums::PushConst, 0);
+    emit(InstructionEnums::Return);
+  }
+  if (options_.inline_size > 0) rememberInlinable();
+  compiled = true;
   return true;
 }
 
-bool Compiler::enrollBlock(
+bool Compiler::Unit::enrollBlock(
     std::map<program::FunctionDeclaration, int, program::FunctionDeclaration::comparer> const& functionDict,
     program::Scope const& block, bool sourcemaps) {
-  int begin = program_.instructions.size() - 1;
-  program_.instructions.push_back(InstructionEnums::IncreaseRegister);
-  program_.instructions.push_back(block.num_variable_declarations);
+  int begin = instructions.size() - 1;
 
   // Insert variable declaration and defintion of the argument list
   for (auto itI = block.statements.cbegin(); itI != block.statements.cend(); ++itI) {
-    if (!enrollStatement(functionDict, *itI, sourcemaps)) return false;
+    // The value of a return statement precedes it
+    auto next = std::next(itI);
+    const bool tail = next != block.statements.cend() && next->value != nullptr &&
+                      next->value->token_type == Base::TokenTypeEnum::ControlFlow &&
+                      dynamic_cast<const ControlFlow*>(next->value)->kind == ControlFlow::KindEnum::Return;
+    if (!enrollStatement(functionDict, *itI, sourcemaps, tail)) return false;
+    // Nothing behind a return statement runs
+    if (unreachable_) break;
   }
 
   if (sourcemaps) {
-    write_scope_to_mapping(block, begin, program_.instructions.size() - 1, mapping_);
+    write_scope_to_mapping(block, begin, instructions.size() - 1, mapping);
   }
-  program_.instructions.push_back(InstructionEnums::DecreaseRegister);
   return true;
 }
 
-bool Compiler::enrollStatement(map<FunctionDeclaration, int, FunctionDeclaration::comparer> const& functionDict,
-                               Statement const& statement, bool sourcemaps) {
+bool Compiler::Unit::enrollStatement(map<FunctionDeclaration, int, FunctionDeclaration::comparer> const& functionDict,
+                               Statement const& statement, bool sourcemaps, bool tail) {
   auto tokenType = statement.value->token_type;
-  if (sourcemaps) {
-    mapping_->Instructions.insert({program_.instructions.size() - 1, statement.location});
+  // Statements created for arguments have no location
+  if (sourcemaps && statement.location.line > 0) {
+    mapping->Instructions.insert({instructions.size() - 1, statement.location});
   }
   if (tokenType == Base::TokenTypeEnum::ConstantInt) {
-    program_.instructions.push_back(InstructionEnums::PushConst);
-    program_.instructions.push_back(statement.value->ByteCode());
+    emit(InstructionEnums::PushConst, statement.value->ByteCode());
   } else if (tokenType == Base::TokenTypeEnum::Label) {
     if (dynamic_cast<Label*>(statement.value)->kind == Label::KindEnum::Function) {
       auto label = dynamic_cast<Label*>(statement.value);
@@ -223,28 +591,38 @@ bool Compiler::enrollStatement(map<FunctionDeclaration, int, FunctionDeclaration
       }
       FunctionDeclaration dec(label->label_string, VariableDeclaration::Length, argTypes);
 
-      int id = external_function_manager.GetId(dec);
+      int id = compiler_->external_function_manager.GetId(dec);
       if (id > -1) {
-        program_.instructions.push_back(InstructionEnums::CallEx);
-        program_.instructions.push_back(id);
+        label->type = compiler_->external_function_manager.GetImageType(id);
+        emit(InstructionEnums::CallEx, id);
+        // External functions pop their arguments and push their image if they have one
+        track_stack((label->type != VariableDeclaration::Void ? 1 : 0) - static_cast<int>(argTypes.size()));
       } else {
+        // Functions call the ones declared before them
         auto it = functionDict.find(dec);
-        if (it == functionDict.end()) {
+        if (it == functionDict.end() || it->second > index_) {
           stringstream st;
           st << "Can not find function " << dec;
           ERROR_MESSAGE_WITH_POS_MAKE_CODE(st, label->position.character_position);
           return false;
         }
         label->type = it->first.image_type;
-        program_.instructions.push_back(InstructionEnums::Call);
-        program_.instructions.push_back(it->second);
+        auto callee = inline_callee(it->second);
+        if (callee != nullptr) {
+          // The copy pops the arguments and leaves the image on the stack itself
+          enrollInline(*callee);
+        } else {
+          // A call in tail position returns to the caller of the current function directly
+          emit(tail ? InstructionEnums::TailCall : InstructionEnums::Call, it->second);
+          // The function pops its arguments and leaves its image on the stack
+          track_stack((label->type != VariableDeclaration::Void ? 1 : 0) - static_cast<int>(argTypes.size()));
+        }
       }
     } else if (dynamic_cast<Label*>(statement.value)->kind == Label::KindEnum::Variable) {
       auto label = dynamic_cast<Label*>(statement.value);
       int address = label->register_address();
       if (address > -1) {
-        program_.instructions.push_back(InstructionEnums::Push);
-        program_.instructions.push_back(address);
+        emit(InstructionEnums::Push, address);
       } else {
         ERROR_MESSAGE_WITH_POS_MAKE_CODE("Not addressed variable found!", label->position.character_position);
         return false;
@@ -258,19 +636,21 @@ bool Compiler::enrollStatement(map<FunctionDeclaration, int, FunctionDeclaration
       int address = dynamic_cast<Label*>(itAddress->value)->register_address();
 
       // TODO(lochbrunner): assign operators can also be used to push values: e.g. i = j++;
+      if (options_.register_instructions && op->ByteCode() == InstructionEnums::IntCopy &&
+          enrollRegisterAssignment(address, *std::next(itAddress))) {
+        return true;
+      }
       if (op->token_children_position == Base::TokenChildrenPosEnum::LeftAndRight) {
         if (!enrollStatement(functionDict, *++itAddress, sourcemaps)) return false;
       }
-      program_.instructions.push_back(op->ByteCode());
-      program_.instructions.push_back(address);
+      emit(op->ByteCode(), address);
     } else if (op->kind == Operator::KindEnum::Pop) {
-      program_.instructions.push_back(InstructionEnums::IntPop);
-      program_.instructions.push_back(dynamic_cast<Label*>(statement.arguments.begin()->value)->register_address());
+      emit(InstructionEnums::IntPop, dynamic_cast<Label*>(statement.arguments.begin()->value)->register_address());
     } else {
       for (auto it = statement.arguments.begin(); it != statement.arguments.end(); ++it) {
         if (!enrollStatement(functionDict, *it, sourcemaps)) return false;
       }
-      program_.instructions.push_back(statement.value->ByteCode());
+      emit(statement.value->ByteCode());
     }
   } else if (tokenType == Base::TokenTypeEnum::ControlFlow) {
     if (dynamic_cast<const ControlFlow*>(statement.value)->kind == ControlFlow::KindEnum::If) {
@@ -282,16 +662,19 @@ bool Compiler::enrollStatement(map<FunctionDeclaration, int, FunctionDeclaration
       assert((++statement.arguments.begin())->value == nullptr);
       assert((++statement.arguments.begin())->block != nullptr);
 
-      enrollStatement(functionDict, *statement.arguments.begin(), sourcemaps);
-
-      program_.instructions.push_back(InstructionEnums::PushConst);
-      program_.instructions.push_back(-1);
-
-      auto itAlt = --program_.instructions.end();
-      program_.instructions.push_back(InstructionEnums::JumpIf);
+      auto const& condition = *statement.arguments.begin();
       auto block = (++statement.arguments.begin())->block;
-      enrollBlock(functionDict, *block, sourcemaps);
-      *itAlt = program_.instructions.size() - 1;
+      // A constant condition gets decided here: Either the block always runs or never
+      if (condition.value->token_type == Base::TokenTypeEnum::ConstantInt) {
+        if (condition.value->ByteCode() != 0 && !enrollBlock(functionDict, *block, sourcemaps)) return false;
+        return true;
+      }
+      size_t altIndex;
+      if (!enrollBranch(functionDict, condition, sourcemaps, &altIndex)) return false;
+      if (!enrollBlock(functionDict, *block, sourcemaps)) return false;
+      instructions[altIndex] = instructions.size() - 1;
+      // The code behind is reachable if the condition does not hold
+      unreachable_ = false;
 
     } else if (dynamic_cast<const ControlFlow*>(statement.value)->kind == ControlFlow::KindEnum::While) {
       // Should have exactly two arguments: First a statement, second a block
@@ -302,42 +685,463 @@ bool Compiler::enrollStatement(map<FunctionDeclaration, int, FunctionDeclaration
       assert((++statement.arguments.begin())->value == nullptr);
       assert((++statement.arguments.begin())->block != nullptr);
 
-      int begin = program_.instructions.size() - 1;
-      enrollStatement(functionDict, *statement.arguments.begin(), sourcemaps);
+      auto const& condition = *statement.arguments.begin();
+      auto block = (++statement.arguments.begin())->block;
+      const bool constant = condition.value->token_type == Base::TokenTypeEnum::ConstantInt;
+      if (constant && condition.value->ByteCode() == 0) return true;
 
-      program_.instructions.push_back(InstructionEnums::PushConst);
-      program_.instructions.push_back(-1);
+      int begin = instructions.size() - 1;
+      size_t altIndex;
+      if (!constant && !enrollBranch(functionDict, condition, sourcemaps, &altIndex)) return false;
 
-      auto itAlt = --program_.instructions.end();
-      program_.instructions.push_back(InstructionEnums::JumpIf);
+      if (!enrollBlock(functionDict, *block, sourcemaps)) return false;
 
-      auto block = (++statement.arguments.begin())->block;
-      enrollBlock(functionDict, *block, sourcemaps);
+      if (!unreachable_) emit(InstructionEnums::Jump, begin);
 
-      program_.instructions.push_back(InstructionEnums::Jump);
-      program_.instructions.push_back(begin);
+      if (constant) {
+        // Only a return statement leaves an endless loop
+        unreachable_ = true;
+      } else {
+        instructions[altIndex] = instructions.size() - 1;
+        unreachable_ = false;
+      }
+    } else if (dynamic_cast<const ControlFlow*>(statement.value)->kind == ControlFlow::KindEnum::Return) {
+      // The value has been pushed by the previous statement. Return drops the scopes the function did not close.
+      emit(InstructionEnums::Return);
+      unreachable_ = true;
+    }
+  }
+  return true;
+}
 
-      *itAlt = program_.instructions.size() - 1;
+bool Compiler::Unit::enrollBranch(map<FunctionDeclaration, int, FunctionDeclaration::comparer> const& functionDict,
+                            Statement const& condition, bool sourcemaps, size_t* elseIndex) {
+  // Compare registers or constants directly
+  if (options_.register_instructions && condition.value != nullptr &&
+      condition.value->token_type == Base::TokenTypeEnum::Operator && condition.arguments.size() == 2) {
+    const int code = condition.value->ByteCode();
+    bool constantA, constantB;
+    int a, b;
+    if (code >= InstructionEnums::IntEqual && code <= InstructionEnums::IntLessEqual &&
+        register_operand(condition.arguments.front(), &constantA, &a) &&
+        register_operand(condition.arguments.back(), &constantB, &b) && !(constantA && constantB)) {
+      // Jump if the comparison does not hold
+      int comparison = InstructionManager::NegateComparison(code);
+      if (constantA) {
+        comparison = InstructionManager::MirrorComparison(comparison);
+        std::swap(a, b);
+        std::swap(constantA, constantB);
+      }
+      if (sourcemaps && condition.location.line > 0) {
+        mapping->Instructions.insert({instructions.size() - 1, condition.location});
+      }
+      const int offset = comparison - InstructionEnums::IntEqual;
+      emit((constantB ? InstructionEnums::JumpIfIntEqualRI : InstructionEnums::JumpIfIntEqualRR) + offset, a, b, -1);
+      *elseIndex = instructions.size() - 1;
+      return true;
     }
   }
+
+  if (!enrollStatement(functionDict, condition, sourcemaps)) return false;
+  emit(InstructionEnums::JumpIfZero, -1);
+  *elseIndex = instructions.size() - 1;
   return true;
 }
 
-std::unique_ptr<State> Compiler::GetProgram() {
-  auto it = program_.instructions.cbegin();
-  if (it == program_.instructions.cend()) return std::unique_ptr<State>(nullptr);
+void Compiler::Unit::enrollFunction(program::ir::Function const& function) {
+  using program::ir::Block;
+  using program::ir::Instruction;
+  using program::ir::Opcode;
+  std::map<Instruction const*, int> uses;
+  for (auto const& block : function.blocks) {
+    for (auto const& instruction : block.instructions) {
+      for (auto operand : instruction.operands) ++uses[operand];
+    }
+  }
+  // A value used only by the instruction following it may be fused into its use or stay on the ALU stack
+  auto used_by = [&uses](Instruction const& value, Instruction const* next) {
+    return next != nullptr && uses[&value] == 1 &&
+           std::find(next->operands.begin(), next->operands.end(), &value) != next->operands.end();
+  };
+  // Whether the value gets pushed by the instruction following it, as the first of its pushes
+  auto pushed_by = [&used_by](Instruction const& value, Instruction const* next) {
+    return used_by(value, next) &&
+           (next->opcode == Opcode::Call || next->opcode == Opcode::CallEx || next->opcode == Opcode::Return);
+  };
+  // Whether the operands of the operation are a register and a register or constant, with the constant second
+  auto register_operands = [](Instruction const& operation) {
+    auto a = operation.operands[0], b = operation.operands[1];
+    if (a->opcode != Opcode::Constant) return true;
+    // Comparisons get mirrored
+    return b->opcode != Opcode::Constant && (operation.opcode == Opcode::Add || operation.opcode == Opcode::Multiply ||
+                                             program::ir::IsComparison(operation.opcode));
+  };
+  // Gets the operands of an operation with register_operands and the offset of its instruction to the ones of Add or
+  // Equal
+  auto operands_of = [](Instruction const& operation, int* a, int* b, bool* constant) {
+    auto left = operation.operands[0], right = operation.operands[1];
+    int code = program::ir::StackInstruction(operation.opcode);
+    if (left->opcode == Opcode::Constant) {
+      std::swap(left, right);
+      if (program::ir::IsComparison(operation.opcode)) code = InstructionManager::MirrorComparison(code);
+    }
+    *a = left->address;
+    *constant = right->opcode == Opcode::Constant;
+    *b = *constant ? right->immediate : right->address;
+    return code - (program::ir::IsComparison(operation.opcode) ? InstructionEnums::IntEqual : InstructionEnums::IntAdd);
+  };
+  // Arithmetic whose result gets pushed by its use and calls whose image stays on the ALU stack for their use
+  Instruction const* deferred = nullptr;
+  auto push = [&](Instruction const& value) {
+    if (&value == deferred && program::ir::IsArithmetic(value.opcode)) {
+      int a, b;
+      bool constant;
+      const int offset = operands_of(value, &a, &b, &constant);
+      emit((constant ? InstructionEnums::PushIntAddRI : InstructionEnums::PushIntAddRR) + offset, a, b);
+    } else if (&value == deferred) {
+      // Left by the call
+    } else if (value.opcode == Opcode::Constant) {
+      emit(InstructionEnums::PushConst, value.immediate);
+    } else {
+      emit(InstructionEnums::Push, value.address);
+    }
+  };
+  auto move = [this](int address, Instruction const& value) {
+    if (value.opcode == Opcode::Constant) {
+      emit(InstructionEnums::MoveRI, address, value.immediate);
+    } else if (value.address != address) {
+      emit(InstructionEnums::MoveRR, address, value.address);
+    }
+  };
+  std::map<Block const*, int> addresses;
+  // Position of each jump target in the program, set once the blocks are placed
+  std::vector<std::pair<size_t, Block const*>> targets;
+  auto jump = [this, &targets](Block const* target) {
+    emit(InstructionEnums::Jump, -1);
+    targets.push_back({instructions.size() - 1, target});
+  };
 
-  auto state = std::make_unique<State>();
-  state->external_function_manager = &external_function_manager;
+  // The statement whose instructions get emitted
+  program::Mapping::Location statement;
+  for (auto block = function.blocks.cbegin(); block != function.blocks.cend(); ++block) {
+    addresses[&*block] = instructions.size() - 1;
+    // Jumps to the following block fall through
+    auto const following = std::next(block) != function.blocks.cend() ? &*std::next(block) : nullptr;
+    for (auto it = block->instructions.cbegin(); it != block->instructions.cend(); ++it) {
+      auto const& instruction = *it;
+      auto const next = std::next(it) != block->instructions.cend() ? &*std::next(it) : nullptr;
+      // A statement begins with the first instruction built from it. Constants and phis emit no code themselves and
+      // other instructions may emit none, so the statement of the next instruction takes the address over.
+      const auto& location = instruction.location;
+      const bool emits = instruction.opcode != Opcode::Constant && instruction.opcode != Opcode::Phi;
+      if (mapping != nullptr && emits && location.line > 0 &&
+          (location.line != statement.line || location.column != statement.column)) {
+        mapping->Instructions[instructions.size() - 1] = location;
+        statement = location;
+      }
+      switch (instruction.opcode) {
+        case Opcode::Constant:
+        case Opcode::Phi:
+          break;
+        case Opcode::Parameter:
+          emit(InstructionEnums::IntPop, instruction.address);
+          break;
+        case Opcode::Load:
+          // Unless it reads the global variable directly
+          if (instruction.address != instruction.immediate) {
+            emit(InstructionEnums::MoveRR, instruction.address, instruction.immediate);
+          }
+          break;
+        case Opcode::Store:
+          move(instruction.immediate, *instruction.operands[0]);
+          break;
+        case Opcode::Copy:
+          move(instruction.address, *instruction.operands[0]);
+          break;
+        case Opcode::Call:
+        case Opcode::CallEx: {
+          for (auto operand : instruction.operands) push(*operand);
+          deferred = nullptr;
+          const int arguments = static_cast<int>(instruction.operands.size());
+          const int image = instruction.has_image ? 1 : 0;
+          // The image stays on the ALU stack if the next instruction would push it first
+          const bool kept = instruction.has_image && pushed_by(instruction, next) && next->operands[0] == &instruction;
+          const bool returned = kept && next->opcode == Opcode::Return;
+          auto callee = instruction.opcode == Opcode::Call ? inline_callee(instruction.immediate) : nullptr;
+          if (instruction.opcode == Opcode::CallEx) {
+            emit(InstructionEnums::CallEx, instruction.immediate);
+            track_stack(image - arguments);
+          } else if (callee != nullptr) {
+            // The copy pops the arguments and leaves the image on the stack itself
+            enrollInline(*callee);
+          } else if (returned) {
+            // Returns to the caller of this function directly
+            emit(InstructionEnums::TailCall, instruction.immediate);
+            track_stack(image - arguments);
+            ++it;
+            break;
+          } else {
+            emit(InstructionEnums::Call, instruction.immediate);
+            track_stack(image - arguments);
+          }
+          if (kept) {
+            deferred = &instruction;
+          } else if (instruction.has_image) {
+            emit(InstructionEnums::IntPop, instruction.address);
+          }
+          break;
+        }
+        case Opcode::Jump:
+          if (instruction.targets[0] != following) jump(instruction.targets[0]);
+          break;
+        case Opcode::Branch: {
+          auto const condition = instruction.operands[0];
+          auto const then = instruction.targets[0], otherwise = instruction.targets[1];
+          int a, b, offset;
+          bool constant;
+          if (condition == deferred) {
+            offset = operands_of(*condition, &a, &b, &constant);
+            offset += InstructionEnums::IntEqual;
+          } else {
+            // Compare the value with zero
+            a = condition->address;
+            b = 0;
+            constant = true;
+            offset = InstructionEnums::IntNotEqual;
+          }
+          // Jump if the condition holds when the block of the other case follows
+          const bool holds = otherwise == following;
+          if (!holds) offset = InstructionManager::NegateComparison(offset);
+          offset -= InstructionEnums::IntEqual;
+          emit((constant ? InstructionEnums::JumpIfIntEqualRI : InstructionEnums::JumpIfIntEqualRR) + offset, a, b, -1);
+          targets.push_back({instructions.size() - 1, holds ? then : otherwise});
+          if (!holds && then != following) jump(then);
+          break;
+        }
+        case Opcode::Return:
+          if (!instruction.operands.empty()) push(*instruction.operands[0]);
+          emit(InstructionEnums::Return);
+          break;
+        default:
+          if (program::ir::IsComparison(instruction.opcode) && next != nullptr && next->opcode == Opcode::Branch &&
+              used_by(instruction, next) && register_operands(instruction)) {
+            deferred = &instruction;
+          } else if (program::ir::IsArithmetic(instruction.opcode) && pushed_by(instruction, next) &&
+                     register_operands(instruction)) {
+            deferred = &instruction;
+          } else if (program::ir::IsArithmetic(instruction.opcode) && register_operands(instruction)) {
+            int a, b;
+            bool constant;
+            const int offset = operands_of(instruction, &a, &b, &constant);
+            emit((constant ? InstructionEnums::IntAddRRI : InstructionEnums::IntAddRRR) + offset, instruction.address,
+                 a, b);
+          } else {
+            push(*instruction.operands[0]);
+            push(*instruction.operands[1]);
+            emit(program::ir::StackInstruction(instruction.opcode));
+            emit(InstructionEnums::IntPop, instruction.address);
+          }
+          break;
+      }
+    }
+  }
+  for (auto const& target : targets) instructions[target.first] = addresses[target.second];
+  unreachable_ = true;
+}
 
-  // Skip version byte
-  int version = (*it++);
+Compiler::Unit const* Compiler::Unit::inline_callee(int function) {
+  if (options_.inline_size <= 0 || function == index_) return nullptr;
+  auto const& callee = compiler_->finished(function);
+  return callee.inlinable ? &callee : nullptr;
+}
 
-  for (; it != program_.instructions.end(); ++it) {
-    state->program.push_back(*it);
+void Compiler::Unit::rememberInlinable() {
+  // Bytecode addresses do not count the placeholder in front
+  auto const& code = instructions;
+  const int end = static_cast<int>(code.size()) - 1;
+  if (end > options_.inline_size) return;
+  for (int pos = 0; pos < end; pos += InstructionManager::GetOperandCount(code[pos + 1]) + 1) {
+    switch (code[pos + 1]) {
+      case InstructionEnums::Return:
+        // Only the last instruction may return, the copy falls through instead
+        if (pos != end - 1) return;
+        break;
+      case InstructionEnums::IncreaseRegister:
+        // Only the setup of the frame
+        if (pos != 0) return;
+        break;
+      case InstructionEnums::Call:
+        if (code[pos + 2] == index_) return;
+        break;
+      case InstructionEnums::TailCall:
+      case InstructionEnums::JumpIf:
+      case InstructionEnums::DecreaseRegister:
+      case InstructionEnums::Exit:
+        return;
+      default:
+        break;
+    }
   }
+  inlinable = true;
+}
 
-  return state;
+void Compiler::Unit::enrollInline(Unit const& callee) {
+  struct Instruction {
+    int code;
+    std::vector<int> operands;
+  };
+  auto const& code = callee.instructions;
+  const int end = static_cast<int>(code.size()) - 1;
+  std::vector<Instruction> body;
+  std::map<int, int> addresses;
+  int target = static_cast<int>(instructions.size()) - 1;
+  // The frame of the function becomes part of the current one and the final Return falls through to the end of the copy
+  frame_extent_ = std::max(frame_extent_, frame_size_ + code[2]);
+  for (int pos = 0; pos < end;) {
+    const int instruction = code[pos + 1];
+    const int count = InstructionManager::GetOperandCount(instruction);
+    addresses[pos] = target;
+    if (pos != 0 && instruction != InstructionEnums::Return) {
+      body.push_back({instruction, std::vector<int>(code.begin() + pos + 2, code.begin() + pos + 2 + count)});
+      target += count + 1;
+    }
+    pos += count + 1;
+  }
+  addresses[end] = target;
+
+  for (auto& instruction : body) {
+    const int mask = InstructionManager::GetRegisterOperands(instruction.code);
+    for (size_t i = 0; i < instruction.operands.size(); ++i) {
+      // The variables of the function get placed behind the ones of the current function
+      if ((mask & (1 << i)) && instruction.operands[i] >= globals_) instruction.operands[i] += frame_size_;
+    }
+    // Calls keep the index of the called function
+    const int jump = InstructionManager::GetTargetOperand(instruction.code);
+    if (jump > -1 && instruction.code != InstructionEnums::Call) {
+      instruction.operands[jump] = addresses[instruction.operands[jump]];
+    }
+    emit(instruction.code);
+    instructions.insert(instructions.end(), instruction.operands.begin(), instruction.operands.end());
+  }
+}
+
+bool Compiler::Unit::enrollRegisterAssignment(int address, Statement const& value) {
+  bool constant;
+  int operand;
+  if (register_operand(value, &constant, &operand)) {
+    emit(constant ? InstructionEnums::MoveRI : InstructionEnums::MoveRR, address, operand);
+    return true;
+  }
+
+  if (value.value == nullptr || value.value->token_type != Base::TokenTypeEnum::Operator) return false;
+  auto op = dynamic_cast<Operator*>(value.value);
+  const int code = op->ByteCode();
+  if (op->assigner || code < InstructionEnums::IntAdd || code > InstructionEnums::IntModulo) return false;
+  if (value.arguments.size() != 2) return false;
+
+  bool constantA, constantB;
+  int a, b;
+  if (!register_operand(value.arguments.front(), &constantA, &a)) return false;
+  if (!register_operand(value.arguments.back(), &constantB, &b)) return false;
+  if (constantA) {
+    // Only commutative operations can take the constant as second operand
+    if (constantB || (code != InstructionEnums::IntAdd && code != InstructionEnums::IntMultiply)) return false;
+    std::swap(a, b);
+    std::swap(constantA, constantB);
+  }
+  const int offset = code - InstructionEnums::IntAdd;
+  emit((constantB ? InstructionEnums::IntAddRRI : InstructionEnums::IntAddRRR) + offset, address, a, b);
+  return true;
+}
+
+void Compiler::Unit::emit(int instruction) {
+  instructions.push_back(instruction);
+  track_stack(InstructionManager::GetStackEffect(instruction));
+  // The operands follow
+  const int target = InstructionManager::GetTargetOperand(instruction);
+  if (target < 0) return;
+  const bool call = instruction == InstructionEnums::Call || instruction == InstructionEnums::TailCall;
+  (call ? calls : jumps).push_back(static_cast<int>(instructions.size()) + target);
+}
+
+void Compiler::Unit::emit(int instruction, int operand) {
+  emit(instruction);
+  instructions.push_back(operand);
+}
+
+void Compiler::Unit::emit(int instruction, int operand, int operand2) {
+  emit(instruction, operand);
+  instructions.push_back(operand2);
+}
+
+void Compiler::Unit::emit(int instruction, int operand, int operand2, int operand3) {
+  emit(instruction, operand, operand2);
+  instructions.push_back(operand3);
+}
+
+void Compiler::Unit::track_stack(int change) {
+  stack_depth_ += change;
+  if (stack_depth_ > max_stack_depth) max_stack_depth = stack_depth_;
+}
+
+std::unique_ptr<State> Compiler::GetProgram() {
+  auto program = CreateProgram();
+  if (program == nullptr) return std::unique_ptr<State>(nullptr);
+  return std::make_unique<State>(std::move(program));
+}
+
+bool Compiler::evaluateCall(int function, std::vector<int> const& arguments, int* result) {
+  const auto key = make_pair(function, arguments);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto evaluation = evaluations_.find(key);
+    if (evaluation != evaluations_.end()) {
+      *result = evaluation->second.second;
+      return evaluation->second.first;
+    }
+  }
+  // The pure function and the ones it calls have been compiled
+  std::set<int> closure;
+  std::vector<int> pending = {function};
+  std::vector<Unit const*> units;
+  while (!pending.empty()) {
+    const int index = pending.back();
+    pending.pop_back();
+    if (!closure.insert(index).second) continue;
+    auto const& unit = *units_[index];
+    units.push_back(&unit);
+    for (auto position : unit.calls) pending.push_back(unit.instructions[position]);
+  }
+  // Enter the global scope, call the function and exit in front of the functions
+  std::vector<int> bytecode = {BYTECODE_VERSION, InstructionEnums::IncreaseRegister,
+                               program_.root.num_variable_declarations};
+  for (auto argument : arguments) bytecode.insert(bytecode.end(), {InstructionEnums::PushConst, argument});
+  bytecode.insert(bytecode.end(), {InstructionEnums::Call, 0, InstructionEnums::Exit});
+  const int call = static_cast<int>(bytecode.size()) - 2;
+  auto ranges = link(units, &bytecode);
+  bytecode[call] = ranges.front().first;
+  int depth = 0;
+  for (auto unit : units) depth = std::max(depth, unit->max_stack_depth);
+  depth += static_cast<int>(arguments.size());
+  // Skip version byte
+  bytecode.erase(bytecode.begin());
+  vm::Runtime runtime(std::make_unique<vm::State>(
+      std::make_shared<const vm::Program>(std::move(bytecode), depth, external_function_manager)));
+  // A function falling off its end leaves no result
+  const bool finished = runtime.RunFor(options.evaluation_budget) == vm::Runtime::Status::Finished &&
+                        runtime.GetState().alu_stack.size() == 1;
+  *result = runtime.GetResult();
+  std::lock_guard<std::mutex> lock(mutex_);
+  evaluations_.emplace(key, make_pair(finished, *result));
+  return finished;
+}
+
+std::shared_ptr<const vm::Program> Compiler::CreateProgram() {
+  if (program_.instructions.empty()) return nullptr;
+  // Skip version byte
+  std::vector<int> bytecode(program_.instructions.cbegin() + 1, program_.instructions.cend());
+  return std::make_shared<const vm::Program>(std::move(bytecode), program_.max_stack_depth, external_function_manager,
+                                             mapping_);
 }
 
 std::shared_ptr<program::Mapping> Compiler::GetMapping() { return mapping_; }
@@ -28,10 +28,15 @@
 #ifndef CHARLIE_COMPILER_H
 #define CHARLIE_COMPILER_H
 
+#include <condition_variable>
 #include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <ostream>
 #include <string>
+#include <utility>
+#include <vector>
 #include "common/exportDefs.h"
 #include "common/logging_component.h"
 
@@ -55,10 +60,39 @@ namespace charlie {
 //
 class Compiler : public common::LoggingComponent {
  public:
+  // Settings of the code generation.
+  struct Options {
+    Options();
+    // Emits register instructions (e.g. IntAddRRR) for assignments whose operands are variables or constants.
+    bool register_instructions;
+    // Folds constant expressions and propagates the constants of variables assigned once before the code generation.
+    bool fold_constants;
+    // Fuses frequent instruction sequences after the code generation.
+    bool peephole;
+    // Copies the code of functions with at most this many bytecode words to their call sites instead of calling them.
+    // Recursive functions and functions returning from other places than their end are called anyway. 0: Never.
+    int inline_size;
+    // Generates the code of the functions from their SSA form (see program/ir), which assigns the registers of the
+    // variables. Functions the SSA form does not support, builds with a source mapping of the variables and builds
+    // without register instructions use the syntax tree.
+    bool ssa;
+    // If not null, the SSA form of each function gets written to it once the registers are assigned.
+    std::ostream *ir_dump;
+    // Calls with constant arguments of functions which neither access global variables nor call external functions get
+    // replaced by their result, if calculating it takes at most this many instructions. Requires the SSA form. 0: Never.
+    int evaluation_budget;
+    // Number of threads compiling the functions. Uses one per hardware thread if less than one.
+    int threads;
+    // Whether the source mapping describes the variables of the functions, which the debugger shows. The mapping
+    // refers to their addresses in the syntax tree, so the functions get compiled from it instead of the SSA form.
+    // Otherwise the source mapping of the SSA form holds the functions and the lines only, e.g. for sampling.
+    bool map_variables;
+  };
   // Creates an object without message delegate.
   xprt Compiler();
   // Creates an object with the specified message delegate.
   xprt Compiler(std::function<void(std::string const &message)> messageDelegate);
+  xprt ~Compiler();
   // Compiles the speciefed C source file to bytecode. Returns true if succeeded.
   xprt bool Build(std::string const &filename, bool sourcemaps);
   // Saves the current program to the file. Optional binary or as readable textfile.
@@ -66,24 +100,41 @@ class Compiler : public common::LoggingComponent {
   xprt bool SaveProgram(std::string const &filename, bool binary = true, bool mapping = false) const;
   // Returns the state containing the current program.
   xprt std::unique_ptr<vm::State> GetProgram();
+  // Returns an immutable image of the current program which any number of states can share.
+  // The external functions get copied: Functions added later are not part of the image.
+  xprt std::shared_ptr<const vm::Program> CreateProgram();
   // Returns the mapping of available, otherwise return nullptr
   xprt std::shared_ptr<program::Mapping> GetMapping();  // TODO: create a struct containing mapping and bytecode
   // External function manager
   api::ExternalFunctionManager external_function_manager;
+  // Settings of the code generation. Must be set before calling Build.
+  Options options;
 
  private:
+  // Code of one function, or of the code outside of all functions, compiled into its own buffer.
+  class Unit;
   // Compiles the syntax tree to bytecode.
   bool compile(bool sourcemaps);
-  // Enrolls a block of the syntax tree to bytecode.
-  bool enrollBlock(
-      std::map<program::FunctionDeclaration, int, program::FunctionDeclaration::comparer> const &functionDict,
-      program::Scope const &block, bool sourcemaps);
-  // Enrolls a statement of the syntax tree to bytecode.
-  bool enrollStatement(
-      std::map<program::FunctionDeclaration, int, program::FunctionDeclaration::comparer> const &functionDict,
-      program::Statement const &statement, bool sourcemaps);
+  // Returns the unit of the function with the index once it has been compiled. Blocks until then.
+  Unit const &finished(int index);
+  // Appends the code of the units to "bytecode", which starts with the version. Call targets get resolved to the
+  // begin of the called unit, which has to be one of them, and jump targets get moved by the begin of their unit.
+  // Returns the begin and end address of each unit.
+  static std::vector<std::pair<int, int>> link(std::vector<Unit const *> const &units, std::vector<int> *bytecode);
+  // Runs the pure function with the index on the code of the functions it calls.
+  // Returns false if it fails or does not finish within the evaluation budget.
+  bool evaluateCall(int function, std::vector<int> const &arguments, int *result);
   // The current program data.
   program::UnresolvedProgram program_;
+  // Index of each function by its declaration
+  std::map<program::FunctionDeclaration, int, program::FunctionDeclaration::comparer> functions_;
+  // The units of the functions in the order of their declarations
+  std::vector<std::unique_ptr<Unit>> units_;
+  // Guards the completion of the units and evaluations_
+  std::mutex mutex_;
+  std::condition_variable finished_;
+  // Results of evaluateCall by function and arguments. The first element is false if the call could not be evaluated.
+  std::map<std::pair<int, std::vector<int>>, std::pair<bool, int>> evaluations_;
   std::shared_ptr<program::Mapping> mapping_;
 };
 }  // namespace charlie
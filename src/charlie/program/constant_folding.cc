@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "constant_folding.h"
+
+#include <climits>
+#include <iterator>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "../token/base.h"
+#include "../vm/instruction.h"
+
+namespace charlie::program {
+
+using token::Base;
+using token::ConstantInt;
+using token::Label;
+using token::Operator;
+using vm::InstructionEnums;
+
+namespace {
+
+// Identifies a variable by the scope which declares it and its name
+typedef std::pair<Scope const *, std::string> Variable;
+
+inline bool is_constant(Statement const &statement) {
+  return statement.value != nullptr && statement.value->token_type == Base::TokenTypeEnum::ConstantInt;
+}
+
+inline int constant_of(Statement const &statement) { return dynamic_cast<ConstantInt const *>(statement.value)->value; }
+
+// Returns the operator if the statement writes the variable of its first argument, otherwise nullptr
+Operator const *writer_of(Statement const &statement) {
+  if (statement.value == nullptr || statement.value->token_type != Base::TokenTypeEnum::Operator) return nullptr;
+  auto op = dynamic_cast<Operator const *>(statement.value);
+  if (!op->assigner && op->kind != Operator::KindEnum::Pop) return nullptr;
+  return statement.arguments.empty() ? nullptr : op;
+}
+
+// Returns true if the statement calls a function
+bool calls_function(Statement const &statement) {
+  if (statement.value != nullptr && statement.value->token_type == Base::TokenTypeEnum::Label &&
+      dynamic_cast<Label const *>(statement.value)->kind == Label::KindEnum::Function)
+    return true;
+  for (auto const &argument : statement.arguments) {
+    if (calls_function(argument)) return true;
+    if (argument.block != nullptr) {
+      for (auto const &nested : argument.block->statements) {
+        if (calls_function(nested)) return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Replaces the token of the statement and its operands with the constant
+void replace(Statement *statement, int value) {
+  auto constant = new ConstantInt(value, statement->value->position);
+  delete statement->value;
+  for (auto &argument : statement->arguments) delete argument.value;
+  statement->arguments.clear();
+  statement->value = constant;
+}
+
+class Folder {
+ public:
+  explicit Folder(UnresolvedProgram *program) : program_(program), writes_(), unresolved_(false), replaced_(0) {}
+
+  int Run() {
+    // Each round may uncover new constants, e.g. a variable assigned to the product of other ones
+    for (int round = 0; round < kMaxRounds; ++round) {
+      const int before = replaced_;
+      fold_scope(&program_->root);
+      for (auto &function : program_->function_declarations) fold_scope(&function.definition);
+      propagate();
+      if (replaced_ == before) break;
+    }
+    return replaced_;
+  }
+
+ private:
+  static const int kMaxRounds = 16;
+
+  // What is known about the assignments of a variable
+  struct Writes {
+    int count;
+    // Whether there is an assignment of a constant in the declaring scope
+    bool constant;
+    int value;
+    // Position of the assignment in the declaring scope
+    Scope *scope;
+    std::list<Statement>::iterator position;
+  };
+
+  // Returns true if the statement is a variable, which gets stored in "variable"
+  bool resolve(Scope const &scope, Statement const &statement, Variable *variable) const {
+    if (statement.value == nullptr || statement.value->token_type != Base::TokenTypeEnum::Label) return false;
+    auto label = dynamic_cast<Label const *>(statement.value);
+    if (label->kind == Label::KindEnum::Function || !label->register_address) return false;
+    auto declaring = scope.GetDeclaringScope(label->label_string, label->register_address());
+    if (declaring == nullptr) return false;
+    *variable = {declaring, label->label_string};
+    return true;
+  }
+
+  void fold_scope(Scope *scope) {
+    for (auto &statement : scope->statements) fold(&statement);
+  }
+
+  // Folds the operands first
+  void fold(Statement *statement) {
+    for (auto &argument : statement->arguments) {
+      if (argument.block != nullptr) fold_scope(argument.block);
+      fold(&argument);
+    }
+    if (statement->value == nullptr || statement->value->token_type != Base::TokenTypeEnum::Operator) return;
+    auto op = dynamic_cast<Operator const *>(statement->value);
+    if (op->assigner || statement->arguments.size() != 2) return;
+    auto const &left = statement->arguments.front();
+    auto const &right = statement->arguments.back();
+    int result;
+    if (!is_constant(left) || !is_constant(right)) return;
+    if (!Evaluate(op->ByteCode(), constant_of(left), constant_of(right), &result)) return;
+    replace(statement, result);
+    ++replaced_;
+  }
+
+  void collect_scope(Scope *scope) {
+    for (auto it = scope->statements.begin(); it != scope->statements.end(); ++it) {
+      collect(*scope, *it);
+      auto op = writer_of(*it);
+      Variable variable;
+      if (op != nullptr && op->kind == Operator::KindEnum::Copy && it->arguments.size() == 2 &&
+          is_constant(it->arguments.back()) && resolve(*scope, it->arguments.front(), &variable) &&
+          variable.first == scope) {
+        auto &writes = writes_[variable];
+        writes.constant = true;
+        writes.value = constant_of(it->arguments.back());
+        writes.scope = scope;
+        writes.position = it;
+      }
+    }
+  }
+
+  // Counts the assignments of each variable
+  void collect(Scope const &scope, Statement const &statement) {
+    if (writer_of(statement) != nullptr) {
+      Variable variable;
+      if (resolve(scope, statement.arguments.front(), &variable))
+        ++writes_[variable].count;
+      else
+        unresolved_ = true;
+    }
+    for (auto const &argument : statement.arguments) {
+      if (argument.block != nullptr)
+        collect_scope(argument.block);
+      else
+        collect(scope, argument);
+    }
+  }
+
+  void propagate() {
+    writes_.clear();
+    unresolved_ = false;
+    collect_scope(&program_->root);
+    for (auto &function : program_->function_declarations) collect_scope(&function.definition);
+    // An assignment to an unknown variable might be one of the candidates
+    if (unresolved_) return;
+
+    for (auto const &entry : writes_) {
+      Writes const &writes = entry.second;
+      if (writes.count != 1 || !writes.constant) continue;
+      for (auto it = std::next(writes.position); it != writes.scope->statements.end(); ++it) {
+        substitute(*writes.scope, &*it, entry.first, writes.value);
+      }
+      // The functions run after the global statements which call them
+      if (writes.scope != &program_->root) continue;
+      bool called = false;
+      for (auto it = program_->root.statements.begin(); it != writes.position && !called; ++it) {
+        called = calls_function(*it);
+      }
+      if (called) continue;
+      for (auto &function : program_->function_declarations) {
+        for (auto &statement : function.definition.statements) {
+          substitute(function.definition, &statement, entry.first, writes.value);
+        }
+      }
+    }
+  }
+
+  // Replaces the reads of the variable with the value
+  void substitute(Scope const &scope, Statement *statement, Variable const &variable, int value) {
+    Variable read;
+    if (resolve(scope, *statement, &read)) {
+      if (read == variable) {
+        replace(statement, value);
+        ++replaced_;
+      }
+      return;
+    }
+    auto it = statement->arguments.begin();
+    // The assigned variable is no read
+    if (writer_of(*statement) != nullptr) ++it;
+    for (; it != statement->arguments.end(); ++it) {
+      if (it->block != nullptr) {
+        for (auto &nested : it->block->statements) substitute(*it->block, &nested, variable, value);
+      } else {
+        substitute(scope, &*it, variable, value);
+      }
+    }
+  }
+
+  UnresolvedProgram *program_;
+  std::map<Variable, Writes> writes_;
+  // Whether the variable of an assignment could not be resolved
+  bool unresolved_;
+  int replaced_;
+};
+
+}  // namespace
+
+bool Evaluate(int code, int a, int b, int *result) {
+  // Overflows wrap around
+  const unsigned int ua = static_cast<unsigned int>(a), ub = static_cast<unsigned int>(b);
+  switch (code) {
+    case InstructionEnums::IntAdd:
+      *result = static_cast<int>(ua + ub);
+      return true;
+    case InstructionEnums::IntSubstract:
+      *result = static_cast<int>(ua - ub);
+      return true;
+    case InstructionEnums::IntMultiply:
+      *result = static_cast<int>(ua * ub);
+      return true;
+    case InstructionEnums::IntDivide:
+    case InstructionEnums::IntModulo:
+      if (b == 0 || (a == INT_MIN && b == -1)) return false;
+      *result = code == InstructionEnums::IntDivide ? a / b : a % b;
+      return true;
+    case InstructionEnums::IntEqual:
+      *result = a == b ? 1 : 0;
+      return true;
+    case InstructionEnums::IntNotEqual:
+      *result = a != b ? 1 : 0;
+      return true;
+    case InstructionEnums::IntGreater:
+      *result = a > b ? 1 : 0;
+      return true;
+    case InstructionEnums::IntGreaterEqual:
+      *result = a >= b ? 1 : 0;
+      return true;
+    case InstructionEnums::IntLess:
+      *result = a < b ? 1 : 0;
+      return true;
+    case InstructionEnums::IntLessEqual:
+      *result = a <= b ? 1 : 0;
+      return true;
+    default:
+      return false;
+  }
+}
+
+int FoldConstants(UnresolvedProgram *program) {
+  Folder folder(program);
+  return folder.Run();
+}
+
+}  // namespace charlie::program
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef CHARLIE_PROGRAM_CONSTANT_FOLDING_H
+#define CHARLIE_PROGRAM_CONSTANT_FOLDING_H
+
+#include "unresolved_program.h"
+
+namespace charlie::program {
+
+// Simplifies the syntax trees before the code generation:
+//   4 - 1                     -> 3
+//   int k = 4; ... 2 * k + i  -> 8 + i
+// Operators whose operands are integer constants get replaced by their result. Divisions and modulos by zero are
+// kept to trap at runtime. A variable which is assigned exactly once, to a constant, gets replaced by the constant
+// where the assignment runs before for sure: Behind it in the scope which declares the variable and, for a global
+// variable assigned before the first call of a function, in all functions.
+// Returns the number of replaced nodes.
+int FoldConstants(UnresolvedProgram *program);
+
+// Calculates the integer operation "code" (vm::IntAdd ... vm::IntModulo or vm::IntEqual ... vm::IntLessEqual) like the
+// VM does. Returns false for other operations and for the ones which have to trap at runtime.
+bool Evaluate(int code, int a, int b, int *result);
+
+}  // namespace charlie::program
+
+#endif  // !CHARLIE_PROGRAM_CONSTANT_FOLDING_H
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "dead_code.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+#include "../vm/instruction.h"
+
+namespace charlie::program {
+
+using vm::InstructionEnums;
+using vm::InstructionManager;
+
+int RemoveUnusedFunctions(UnresolvedProgram *program, std::vector<std::pair<int, int>> const &functions,
+                          Mapping *mapping) {
+  // Bytecode addresses do not count the version in front
+  auto &bytecode = program->instructions;
+  const int end = static_cast<int>(bytecode.size()) - 1;
+  std::map<int, int> ends(functions.begin(), functions.end());
+
+  // Walk the calls starting with the code outside of all functions
+  std::vector<std::pair<int, int>> pending;
+  int previous = 0;
+  for (auto const &function : ends) {
+    pending.push_back({previous, function.first});
+    previous = function.second;
+  }
+  pending.push_back({previous, end});
+  std::set<int> used;
+  while (!pending.empty()) {
+    const auto range = pending.back();
+    pending.pop_back();
+    for (int pos = range.first; pos < range.second;) {
+      const int code = bytecode[pos + 1];
+      const int count = InstructionManager::GetOperandCount(code);
+      if (count < 0) return 0;
+      if (code == InstructionEnums::Call || code == InstructionEnums::TailCall) {
+        auto callee = ends.find(bytecode[pos + 2]);
+        if (callee != ends.end() && used.insert(callee->first).second) pending.push_back(*callee);
+      }
+      pos += count + 1;
+    }
+  }
+  if (used.size() == ends.size()) return 0;
+
+  std::vector<std::pair<int, int>> removed;
+  for (auto const &function : ends) {
+    if (used.count(function.first) == 0) removed.push_back(function);
+  }
+  // "removed" is sorted and its ranges are disjoint. "removed_before[i]" is the length of the first i ranges.
+  std::vector<int> removed_before = {0};
+  for (auto const &range : removed) removed_before.push_back(removed_before.back() + range.second - range.first);
+  // Index of the first removed range which ends behind the address
+  auto first_behind = [&](int address) {
+    auto it = std::upper_bound(removed.begin(), removed.end(), address,
+                               [](int address, std::pair<int, int> const &range) { return address < range.second; });
+    return static_cast<int>(it - removed.begin());
+  };
+  auto is_removed = [&](int address) {
+    const int i = first_behind(address);
+    return i < static_cast<int>(removed.size()) && removed[i].first <= address;
+  };
+  auto remap = [&](int address) { return address - removed_before[first_behind(address)]; };
+
+  std::vector<int> kept = {bytecode[0]};
+  for (int pos = 0; pos < end;) {
+    const int count = InstructionManager::GetOperandCount(bytecode[pos + 1]);
+    if (!is_removed(pos)) {
+      const int address = static_cast<int>(kept.size()) - 1;
+      kept.insert(kept.end(), bytecode.begin() + pos + 1, bytecode.begin() + pos + 2 + count);
+      const int target = InstructionManager::GetTargetOperand(bytecode[pos + 1]);
+      if (target > -1) kept[address + 2 + target] = remap(bytecode[pos + 2 + target]);
+    }
+    pos += count + 1;
+  }
+  bytecode = std::move(kept);
+
+  if (mapping != nullptr) {
+    auto functions_end = std::remove_if(mapping->Functions.begin(), mapping->Functions.end(),
+                                        [&](std::unique_ptr<Mapping::Function> const &function) {
+                                          return is_removed(function->scope.begin);
+                                        });
+    mapping->Functions.erase(functions_end, mapping->Functions.end());
+    for (auto &function : mapping->Functions) {
+      function->scope.begin = remap(function->scope.begin);
+      function->scope.end = remap(function->scope.end);
+    }
+    auto scopes_end = std::remove_if(mapping->Scopes.begin(), mapping->Scopes.end(),
+                                     [&](std::unique_ptr<Mapping::Scope> const &scope) {
+                                       return is_removed(scope->begin);
+                                     });
+    mapping->Scopes.erase(scopes_end, mapping->Scopes.end());
+    for (auto &scope : mapping->Scopes) {
+      scope->begin = remap(scope->begin);
+      scope->end = remap(scope->end);
+    }
+    std::map<int, Mapping::Location> locations(mapping->Instructions.begin(), mapping->Instructions.end());
+    mapping->Instructions.clear();
+    for (auto &location : locations) {
+      if (!is_removed(location.first)) mapping->Instructions.insert({remap(location.first), location.second});
+    }
+  }
+  return static_cast<int>(removed.size());
+}
+
+}  // namespace charlie::program
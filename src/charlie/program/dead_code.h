@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef CHARLIE_PROGRAM_DEAD_CODE_H
+#define CHARLIE_PROGRAM_DEAD_CODE_H
+
+#include <utility>
+#include <vector>
+
+#include "mapping.h"
+#include "unresolved_program.h"
+
+namespace charlie::program {
+
+// Removes the code of the functions which are not called from the code outside of all functions or from the other
+// remaining functions, e.g. functions which got inlined at all call sites.
+// "functions": Begin and end address of the code of each function.
+// Jump targets, call targets and the addresses of the mapping (which may be nullptr) get moved to the new positions.
+// Returns the number of removed functions.
+int RemoveUnusedFunctions(UnresolvedProgram *program, std::vector<std::pair<int, int>> const &functions,
+                          Mapping *mapping);
+
+}  // namespace charlie::program
+
+#endif  // !CHARLIE_PROGRAM_DEAD_CODE_H
@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "builder.h"
+
+#include <list>
+#include <map>
+#include <set>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include "../../token/base.h"
+#include "../../vm/instruction.h"
+
+namespace charlie::program::ir {
+
+using token::Base;
+using token::ControlFlow;
+using token::Label;
+using token::Operator;
+using vm::InstructionEnums;
+
+namespace {
+
+// Constructs the SSA form while walking the syntax tree, following Braun et al.: "Simple and Efficient Construction of
+// Static Single Assignment Form". Each local variable is identified by its register address.
+class Builder {
+ public:
+  Builder(FunctionDeclaration const &declaration, int globals, CalleeResolver const &resolve)
+      : declaration_(declaration),
+        globals_(globals),
+        resolve_(resolve),
+        function_(),
+        current_(nullptr),
+        location_(),
+        parameters_(0),
+        definitions_(),
+        sealed_(),
+        incomplete_() {}
+
+  std::unique_ptr<Function> Run() {
+    std::stringstream name;
+    name << declaration_;
+    function_ = std::make_unique<Function>(name.str());
+    current_ = function_->AddBlock();
+    sealed_.insert(current_);
+    if (!block(declaration_.definition)) return nullptr;
+    // Falling off the end of a function with an image returns 0, like the bytecode of the syntax tree does
+    if (current_ != nullptr) {
+      auto zero = declaration_.image_type != VariableDeclaration::Void ? constant(0) : nullptr;
+      auto instruction = append(Opcode::Return);
+      if (zero != nullptr) instruction->operands.push_back(zero);
+    }
+    return std::move(function_);
+  }
+
+ private:
+  bool block(Scope const &scope) {
+    // The instructions following the nested block belong to the enclosing statement again
+    const auto enclosing = location_;
+    // The value of a return statement is the one of the statement in front of it
+    Instruction *previous = nullptr;
+    for (auto const &statement : scope.statements) {
+      // Nothing behind a return statement runs
+      if (current_ == nullptr) break;
+      location_ = statement.location;
+      if (statement.value != nullptr && statement.value->token_type == Base::TokenTypeEnum::ControlFlow &&
+          dynamic_cast<ControlFlow const *>(statement.value)->kind == ControlFlow::KindEnum::Return) {
+        auto instruction = append(Opcode::Return);
+        if (declaration_.image_type != VariableDeclaration::Void) {
+          if (previous == nullptr) return false;
+          instruction->operands.push_back(previous);
+        }
+        current_ = nullptr;
+        break;
+      }
+      if (!this->statement(statement, &previous)) return false;
+    }
+    location_ = enclosing;
+    return true;
+  }
+
+  // Translates the statement. "value": The value it leaves or nullptr.
+  bool statement(Statement const &statement, Instruction **value) {
+    *value = nullptr;
+    if (statement.value == nullptr) return false;
+    switch (statement.value->token_type) {
+      case Base::TokenTypeEnum::ConstantInt:
+        *value = constant(statement.value->ByteCode());
+        return true;
+      case Base::TokenTypeEnum::Label:
+        return label(statement, value);
+      case Base::TokenTypeEnum::Operator:
+        return operation(statement, value);
+      case Base::TokenTypeEnum::ControlFlow:
+        return control_flow(statement);
+      default:
+        return false;
+    }
+  }
+
+  // Translates the statement which has to leave a value
+  Instruction *expression(Statement const &statement) {
+    Instruction *value;
+    return this->statement(statement, &value) ? value : nullptr;
+  }
+
+  bool label(Statement const &statement, Instruction **value) {
+    auto label = dynamic_cast<Label const *>(statement.value);
+    if (label->kind == Label::KindEnum::Variable) {
+      int address;
+      if (!variable(statement, &address)) return false;
+      *value = read(address);
+      return true;
+    }
+    if (label->kind != Label::KindEnum::Function) return false;
+    std::vector<Instruction *> arguments;
+    std::list<VariableDeclaration> types;
+    for (auto const &argument : statement.arguments) {
+      auto value = expression(argument);
+      if (value == nullptr) return false;
+      arguments.push_back(value);
+      types.push_back(VariableDeclaration::Int);
+    }
+    Callee callee;
+    if (!resolve_(FunctionDeclaration(label->label_string, VariableDeclaration::Length, types), &callee)) return false;
+    auto call = append(callee.external ? Opcode::CallEx : Opcode::Call);
+    call->immediate = callee.id;
+    call->has_image = callee.has_image;
+    call->operands = arguments;
+    if (callee.has_image) *value = call;
+    return true;
+  }
+
+  // Gets the register address of an integer variable
+  bool variable(Statement const &statement, int *address) const {
+    if (statement.value == nullptr || statement.value->token_type != Base::TokenTypeEnum::Label) return false;
+    auto label = dynamic_cast<Label const *>(statement.value);
+    if (label->kind != Label::KindEnum::Variable || label->type != VariableDeclaration::Int || !label->register_address)
+      return false;
+    *address = label->register_address();
+    return *address > -1;
+  }
+
+  bool operation(Statement const &statement, Instruction **value) {
+    auto op = dynamic_cast<Operator const *>(statement.value);
+    int address;
+    if (op->kind == Operator::KindEnum::Pop) {
+      if (statement.arguments.empty() || !variable(statement.arguments.front(), &address)) return false;
+      // The arguments get popped in reverse order
+      auto parameter = append(Opcode::Parameter);
+      parameter->immediate = static_cast<int>(declaration_.argument_types.size()) - 1 - parameters_++;
+      write(address, parameter);
+      return true;
+    }
+    if (op->assigner) {
+      if (statement.arguments.empty() || !variable(statement.arguments.front(), &address)) return false;
+      Instruction *assigned;
+      if (op->kind == Operator::KindEnum::Copy && statement.arguments.size() == 2) {
+        assigned = expression(statement.arguments.back());
+        if (assigned == nullptr) return false;
+      } else if ((op->kind == Operator::KindEnum::Increase || op->kind == Operator::KindEnum::Decrease) &&
+                 statement.arguments.size() == 1) {
+        auto value = read(address);
+        auto one = constant(1);
+        assigned = append(op->kind == Operator::KindEnum::Increase ? Opcode::Add : Opcode::Substract);
+        assigned->operands = {value, one};
+      } else {
+        return false;
+      }
+      write(address, assigned);
+      return true;
+    }
+    const int code = op->ByteCode();
+    Opcode opcode;
+    if (code >= InstructionEnums::IntAdd && code <= InstructionEnums::IntModulo) {
+      opcode = static_cast<Opcode>(static_cast<int>(Opcode::Add) + code - InstructionEnums::IntAdd);
+    } else if (code >= InstructionEnums::IntEqual && code <= InstructionEnums::IntLessEqual) {
+      opcode = static_cast<Opcode>(static_cast<int>(Opcode::Equal) + code - InstructionEnums::IntEqual);
+    } else {
+      return false;
+    }
+    if (statement.arguments.size() != 2) return false;
+    auto left = expression(statement.arguments.front());
+    if (left == nullptr) return false;
+    auto right = expression(statement.arguments.back());
+    if (right == nullptr) return false;
+    *value = append(opcode);
+    (*value)->operands = {left, right};
+    return true;
+  }
+
+  bool control_flow(Statement const &statement) {
+    auto kind = dynamic_cast<ControlFlow const *>(statement.value)->kind;
+    if (kind != ControlFlow::KindEnum::If && kind != ControlFlow::KindEnum::While) return false;
+    if (statement.arguments.size() != 2 || statement.arguments.back().block == nullptr) return false;
+    auto const &condition = statement.arguments.front();
+    auto const &body = *statement.arguments.back().block;
+    // Constant conditions decide here, like for the bytecode of the syntax tree
+    const bool constant = condition.value != nullptr && condition.value->token_type == Base::TokenTypeEnum::ConstantInt;
+    if (constant && condition.value->ByteCode() == 0) return true;
+    // The statement itself is located behind its body
+    location_ = condition.location;
+    if (kind == ControlFlow::KindEnum::If) {
+      if (constant) return block(body);
+      auto value = expression(condition);
+      if (value == nullptr) return false;
+      auto then = function_->AddBlock();
+      auto join = function_->AddBlock();
+      branch(value, then, join);
+      sealed_.insert(then);
+      current_ = then;
+      if (!block(body)) return false;
+      if (current_ != nullptr) jump(join);
+      seal(join);
+      current_ = join;
+      return true;
+    }
+    auto header = function_->AddBlock();
+    jump(header);
+    current_ = header;
+    Block *exit = nullptr;
+    if (!constant) {
+      auto value = expression(condition);
+      if (value == nullptr) return false;
+      auto loop = function_->AddBlock();
+      exit = function_->AddBlock();
+      branch(value, loop, exit);
+      sealed_.insert(loop);
+      sealed_.insert(exit);
+      current_ = loop;
+    }
+    if (!block(body)) return false;
+    if (current_ != nullptr) jump(header);
+    seal(header);
+    // Only a return statement leaves an endless loop
+    current_ = exit;
+    return true;
+  }
+
+  Instruction *constant(int value) {
+    auto instruction = append(Opcode::Constant);
+    instruction->immediate = value;
+    return instruction;
+  }
+
+  void jump(Block *target) {
+    append(Opcode::Jump)->targets.push_back(target);
+    target->predecessors.push_back(current_);
+  }
+
+  void branch(Instruction *condition, Block *then, Block *otherwise) {
+    auto instruction = append(Opcode::Branch);
+    instruction->operands.push_back(condition);
+    instruction->targets = {then, otherwise};
+    then->predecessors.push_back(current_);
+    otherwise->predecessors.push_back(current_);
+  }
+
+  void write(int address, Instruction *value) {
+    if (address < globals_) {
+      auto store = append(Opcode::Store);
+      store->immediate = address;
+      store->operands.push_back(value);
+    } else {
+      definitions_[address][current_] = value;
+    }
+  }
+
+  Instruction *read(int address) {
+    if (address >= globals_) return read(address, current_);
+    auto load = append(Opcode::Load);
+    load->immediate = address;
+    return load;
+  }
+
+  Instruction *read(int address, Block *block) {
+    auto &definitions = definitions_[address];
+    auto it = definitions.find(block);
+    if (it != definitions.end()) return it->second;
+    Instruction *value;
+    if (sealed_.count(block) == 0) {
+      // The operands get added once all predecessors are known
+      value = phi(block);
+      incomplete_[block].push_back({address, value});
+    } else if (block->predecessors.empty()) {
+      // Read before any assignment
+      value = function_->Insert(block, block->instructions.begin(), Opcode::Constant);
+    } else if (block->predecessors.size() == 1) {
+      value = read(address, block->predecessors.front());
+    } else {
+      // Breaks cycles through loops
+      value = phi(block);
+      definitions_[address][block] = value;
+      add_operands(address, value);
+    }
+    definitions_[address][block] = value;
+    return value;
+  }
+
+  // Appends the instruction to the current block, built from the current statement
+  Instruction *append(Opcode opcode) {
+    auto instruction = function_->Append(current_, opcode);
+    instruction->location = location_;
+    return instruction;
+  }
+
+  Instruction *phi(Block *block) { return function_->Insert(block, block->instructions.begin(), Opcode::Phi); }
+
+  void add_operands(int address, Instruction *phi) {
+    for (auto predecessor : phi->block->predecessors) phi->operands.push_back(read(address, predecessor));
+  }
+
+  void seal(Block *block) {
+    for (auto const &entry : incomplete_[block]) add_operands(entry.first, entry.second);
+    incomplete_.erase(block);
+    sealed_.insert(block);
+  }
+
+  FunctionDeclaration const &declaration_;
+  const int globals_;
+  CalleeResolver const &resolve_;
+  std::unique_ptr<Function> function_;
+  // Block the next instruction gets appended to. nullptr if the code is unreachable.
+  Block *current_;
+  // Location of the statement being translated
+  Mapping::Location location_;
+  // Number of the parameters popped so far
+  int parameters_;
+  // Current value of each local variable at the end of each block
+  std::map<int, std::map<Block *, Instruction *>> definitions_;
+  // Blocks whose predecessors are all known
+  std::set<Block *> sealed_;
+  // Phis of unsealed blocks whose operands are missing, with the address of their variable
+  std::map<Block *, std::vector<std::pair<int, Instruction *>>> incomplete_;
+};
+
+}  // namespace
+
+std::unique_ptr<Function> Build(FunctionDeclaration const &declaration, int globals, CalleeResolver const &resolve) {
+  Builder builder(declaration, globals, resolve);
+  return builder.Run();
+}
+
+}  // namespace charlie::program::ir
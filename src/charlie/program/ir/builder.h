@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef CHARLIE_PROGRAM_IR_BUILDER_H
+#define CHARLIE_PROGRAM_IR_BUILDER_H
+
+#include <functional>
+#include <memory>
+
+#include "../function_declaration.h"
+#include "ir.h"
+
+namespace charlie::program::ir {
+
+// The function a call refers to
+struct Callee {
+  // Whether it is an external function
+  bool external;
+  // Index of the function or id of the external function
+  int id;
+  // Whether the function leaves a value
+  bool has_image;
+};
+
+// Looks up the function with the signature of a call. Returns false if there is none.
+typedef std::function<bool(FunctionDeclaration const &signature, Callee *callee)> CalleeResolver;
+
+// Translates the definition of the function into SSA form. Global variables are the ones at register addresses below
+// "globals". Local variables become values, global ones get loaded and stored.
+// Returns nullptr if the function uses something else than integer variables, arithmetic, comparisons, if, while,
+// return and calls of functions taking and returning integers.
+std::unique_ptr<Function> Build(FunctionDeclaration const &declaration, int globals, CalleeResolver const &resolve);
+
+}  // namespace charlie::program::ir
+
+#endif  // !CHARLIE_PROGRAM_IR_BUILDER_H
@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "ir.h"
+
+#include <algorithm>
+
+#include "../../vm/instruction.h"
+
+namespace charlie::program::ir {
+
+Instruction::Instruction(Opcode opcode, int id)
+    : opcode(opcode),
+      id(id),
+      operands(),
+      immediate(0),
+      has_image(false),
+      targets(),
+      block(nullptr),
+      address(-1),
+      location() {}
+
+bool Instruction::HasValue() const {
+  switch (opcode) {
+    case Opcode::Store:
+    case Opcode::Jump:
+    case Opcode::Branch:
+    case Opcode::Return:
+      return false;
+    case Opcode::Call:
+    case Opcode::CallEx:
+      return has_image;
+    default:
+      return true;
+  }
+}
+
+bool Instruction::IsTerminator() const {
+  return opcode == Opcode::Jump || opcode == Opcode::Branch || opcode == Opcode::Return;
+}
+
+bool Instruction::HasSideEffects() const {
+  switch (opcode) {
+    // The arguments have to be popped anyway
+    case Opcode::Parameter:
+    case Opcode::Store:
+    case Opcode::Call:
+    case Opcode::CallEx:
+      return true;
+    // Division by zero and of INT_MIN by -1 trap
+    case Opcode::Divide:
+    case Opcode::Modulo:
+      return operands[1]->opcode != Opcode::Constant || operands[1]->immediate == 0 || operands[1]->immediate == -1;
+    default:
+      return IsTerminator();
+  }
+}
+
+Block::Block(int id) : id(id), instructions(), predecessors() {}
+
+Instruction *Block::Terminator() {
+  if (instructions.empty() || !instructions.back().IsTerminator()) return nullptr;
+  return &instructions.back();
+}
+
+Instruction const *Block::Terminator() const {
+  if (instructions.empty() || !instructions.back().IsTerminator()) return nullptr;
+  return &instructions.back();
+}
+
+std::vector<Block *> Block::Successors() const {
+  auto terminator = Terminator();
+  return terminator != nullptr ? terminator->targets : std::vector<Block *>();
+}
+
+int Block::PredecessorIndex(Block const *block) const {
+  auto it = std::find(predecessors.begin(), predecessors.end(), block);
+  return it != predecessors.end() ? static_cast<int>(it - predecessors.begin()) : -1;
+}
+
+Function::Function(std::string const &name) : name(name), blocks(), frame_size(0), next_value_(0), next_block_(0) {}
+
+Block *Function::AddBlock(std::list<Block>::iterator position) { return &*blocks.emplace(position, next_block_++); }
+
+Block *Function::AddBlock() { return AddBlock(blocks.end()); }
+
+Instruction *Function::Insert(Block *block, std::list<Instruction>::iterator position, Opcode opcode) {
+  auto instruction = &*block->instructions.emplace(position, opcode, next_value_++);
+  instruction->block = block;
+  return instruction;
+}
+
+Instruction *Function::Append(Block *block, Opcode opcode) {
+  return Insert(block, block->instructions.end(), opcode);
+}
+
+void Function::ReplaceUses(Instruction const *value, Instruction *replacement) {
+  for (auto &block : blocks) {
+    for (auto &instruction : block.instructions) {
+      std::replace(instruction.operands.begin(), instruction.operands.end(), const_cast<Instruction *>(value),
+                   replacement);
+    }
+  }
+}
+
+int Function::CountUses(Instruction const *value) const {
+  int uses = 0;
+  for (auto const &block : blocks) {
+    for (auto const &instruction : block.instructions) {
+      uses += static_cast<int>(std::count(instruction.operands.begin(), instruction.operands.end(), value));
+    }
+  }
+  return uses;
+}
+
+void Function::RemoveEdge(Block *from, Block *to) {
+  const int index = to->PredecessorIndex(from);
+  if (index < 0) return;
+  to->predecessors.erase(to->predecessors.begin() + index);
+  for (auto &instruction : to->instructions) {
+    if (instruction.opcode != Opcode::Phi) break;
+    instruction.operands.erase(instruction.operands.begin() + index);
+  }
+}
+
+Block *Function::SplitEdge(Block *from, Block *to) {
+  // Behind "from" the jump is likely to become a fall through
+  auto position = std::find_if(blocks.begin(), blocks.end(), [from](Block const &block) { return &block == from; });
+  auto block = AddBlock(std::next(position));
+  block->predecessors.push_back(from);
+  Append(block, Opcode::Jump)->targets.push_back(to);
+  auto &targets = from->Terminator()->targets;
+  std::replace(targets.begin(), targets.end(), to, block);
+  // The phis of "to" keep their operands
+  std::replace(to->predecessors.begin(), to->predecessors.end(), from, block);
+  return block;
+}
+
+const char *OpcodeName(Opcode opcode) {
+  switch (opcode) {
+    case Opcode::Constant:
+      return "const";
+    case Opcode::Parameter:
+      return "param";
+    case Opcode::Load:
+      return "load";
+    case Opcode::Store:
+      return "store";
+    case Opcode::Add:
+      return "add";
+    case Opcode::Substract:
+      return "sub";
+    case Opcode::Multiply:
+      return "mul";
+    case Opcode::Divide:
+      return "div";
+    case Opcode::Modulo:
+      return "mod";
+    case Opcode::Equal:
+      return "eq";
+    case Opcode::NotEqual:
+      return "ne";
+    case Opcode::Greater:
+      return "gt";
+    case Opcode::GreaterEqual:
+      return "ge";
+    case Opcode::Less:
+      return "lt";
+    case Opcode::LessEqual:
+      return "le";
+    case Opcode::Phi:
+      return "phi";
+    case Opcode::Copy:
+      return "copy";
+    case Opcode::Call:
+      return "call";
+    case Opcode::CallEx:
+      return "callex";
+    case Opcode::Jump:
+      return "jump";
+    case Opcode::Branch:
+      return "branch";
+    case Opcode::Return:
+      return "return";
+  }
+  return "?";
+}
+
+bool IsArithmetic(Opcode opcode) { return opcode >= Opcode::Add && opcode <= Opcode::Modulo; }
+
+bool IsComparison(Opcode opcode) { return opcode >= Opcode::Equal && opcode <= Opcode::LessEqual; }
+
+int StackInstruction(Opcode opcode) {
+  if (IsArithmetic(opcode)) return vm::IntAdd + static_cast<int>(opcode) - static_cast<int>(Opcode::Add);
+  return vm::IntEqual + static_cast<int>(opcode) - static_cast<int>(Opcode::Equal);
+}
+
+std::ostream &operator<<(std::ostream &stream, Function const &function) {
+  stream << "function " << function.name << "\n";
+  for (auto const &block : function.blocks) {
+    stream << "b" << block.id << ":";
+    for (size_t i = 0; i < block.predecessors.size(); ++i) {
+      stream << (i == 0 ? "  ; preds b" : ", b") << block.predecessors[i]->id;
+    }
+    stream << "\n";
+    for (auto const &instruction : block.instructions) {
+      stream << "  ";
+      if (instruction.HasValue()) stream << "%" << instruction.id << " = ";
+      stream << OpcodeName(instruction.opcode);
+      const char *separator = " ";
+      switch (instruction.opcode) {
+        case Opcode::Constant:
+        case Opcode::Parameter:
+        case Opcode::Call:
+        case Opcode::CallEx:
+          stream << " " << instruction.immediate;
+          separator = ", ";
+          break;
+        case Opcode::Load:
+        case Opcode::Store:
+          stream << " @" << instruction.immediate;
+          separator = ", ";
+          break;
+        default:
+          break;
+      }
+      for (size_t i = 0; i < instruction.operands.size(); ++i) {
+        stream << separator << "%" << instruction.operands[i]->id;
+        if (instruction.opcode == Opcode::Phi) stream << " [b" << block.predecessors[i]->id << "]";
+        separator = ", ";
+      }
+      for (auto target : instruction.targets) {
+        stream << separator << "b" << target->id;
+        separator = ", ";
+      }
+      if (instruction.address > -1) stream << "  ; @" << instruction.address;
+      stream << "\n";
+    }
+  }
+  return stream;
+}
+
+}  // namespace charlie::program::ir
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef CHARLIE_PROGRAM_IR_IR_H
+#define CHARLIE_PROGRAM_IR_IR_H
+
+#include <list>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "../mapping.h"
+
+namespace charlie::program::ir {
+
+struct Block;
+
+// Operations of the intermediate representation. All values are integers.
+enum class Opcode {
+  // The integer "immediate"
+  Constant,
+  // Argument of the function which gets popped from the ALU stack at its entry. "immediate": Index of the argument
+  Parameter,
+  // Reads the global variable at the register address "immediate"
+  Load,
+  // Writes the operand to the global variable at the register address "immediate"
+  Store,
+  // Arithmetic on the two operands. Same order as vm::IntAdd ... vm::IntModulo
+  Add,
+  Substract,
+  Multiply,
+  Divide,
+  Modulo,
+  // Comparison of the two operands resulting in 0 or 1. Same order as vm::IntEqual ... vm::IntLessEqual
+  Equal,
+  NotEqual,
+  Greater,
+  GreaterEqual,
+  Less,
+  LessEqual,
+  // Takes the operand which belongs to the predecessor the block has been entered from
+  Phi,
+  // Copies the operand. Only used when leaving the SSA form.
+  Copy,
+  // Calls the function with the index "immediate", which gets resolved to its address when linking, with the operands
+  // as arguments
+  Call,
+  // Calls the external function with the id "immediate" with the operands as arguments
+  CallEx,
+  // Continues with the target
+  Jump,
+  // Continues with the first target if the operand is not zero, otherwise with the second one
+  Branch,
+  // Returns the operand to the caller. Without operand the ALU stack is left as it is.
+  Return
+};
+
+// An operation and the value it defines
+struct Instruction {
+  Instruction(Opcode opcode, int id);
+  // Returns true if the instruction defines a value
+  bool HasValue() const;
+  // Returns true for the instructions which end a block: Jump, Branch and Return
+  bool IsTerminator() const;
+  // Returns true if the instruction must not be removed if its value is unused
+  bool HasSideEffects() const;
+  Opcode opcode;
+  // Number of the value in the textual form
+  int id;
+  // The phis of a block have one operand for each predecessor of the block in the same order
+  std::vector<Instruction *> operands;
+  // Meaning depends on the opcode
+  int immediate;
+  // Call and CallEx: Whether the function leaves a value
+  bool has_image;
+  // Jump: The successor. Branch: The successors if the condition holds and if it does not hold.
+  std::vector<Block *> targets;
+  // The block containing the instruction
+  Block *block;
+  // Register address which holds the value, assigned when leaving the SSA form. -1: None, e.g. constants.
+  int address;
+  // Location of the statement the instruction has been built from. Line 0: None, e.g. for the ones added by passes.
+  Mapping::Location location;
+};
+
+// Sequence of instructions ending with a terminator. Only the terminator may leave it.
+struct Block {
+  explicit Block(int id);
+  // Returns the last instruction if it is a terminator, otherwise nullptr
+  Instruction *Terminator();
+  Instruction const *Terminator() const;
+  // Returns the targets of the terminator
+  std::vector<Block *> Successors() const;
+  // Returns the position of "block" in the predecessors or -1
+  int PredecessorIndex(Block const *block) const;
+  // Number of the block in the textual form
+  int id;
+  std::list<Instruction> instructions;
+  std::vector<Block *> predecessors;
+};
+
+// Control-flow graph of one function. The first block is the entry. The order of the blocks is the order of their code.
+struct Function {
+  explicit Function(std::string const &name);
+  Function(Function const &) = delete;
+  Function &operator=(Function const &) = delete;
+  // Adds an empty block in front of "position"
+  Block *AddBlock(std::list<Block>::iterator position);
+  Block *AddBlock();
+  // Adds an instruction in front of "position" of the block
+  Instruction *Insert(Block *block, std::list<Instruction>::iterator position, Opcode opcode);
+  Instruction *Append(Block *block, Opcode opcode);
+  // Replaces the uses of "value" by "replacement"
+  void ReplaceUses(Instruction const *value, Instruction *replacement);
+  // Returns the number of uses of "value"
+  int CountUses(Instruction const *value) const;
+  // Removes the edge from the predecessor "from" to "to" together with the belonging operands of the phis of "to".
+  // The terminator of "from" has to be changed by the caller.
+  static void RemoveEdge(Block *from, Block *to);
+  // Inserts a block on the edge from "from" to "to", which jumps to "to".
+  Block *SplitEdge(Block *from, Block *to);
+  // Writes the function in textual form.
+  friend std::ostream &operator<<(std::ostream &stream, Function const &function);
+
+  std::string name;
+  std::list<Block> blocks;
+  // Number of register slots the function needs for its values, assigned when leaving the SSA form
+  int frame_size;
+
+ private:
+  int next_value_;
+  int next_block_;
+};
+
+// Returns the name of the opcode in the textual form
+const char *OpcodeName(Opcode opcode);
+// Add ... Modulo
+bool IsArithmetic(Opcode opcode);
+// Equal ... LessEqual
+bool IsComparison(Opcode opcode);
+// Returns the bytecode instruction working on the ALU stack (vm::IntAdd ... vm::IntLessEqual) of an arithmetic
+// operation or comparison.
+int StackInstruction(Opcode opcode);
+
+}  // namespace charlie::program::ir
+
+#endif  // !CHARLIE_PROGRAM_IR_IR_H
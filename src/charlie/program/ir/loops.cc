@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "passes.h"
+
+namespace charlie::program::ir {
+
+namespace {
+
+// Natural loop of a back edge, merged with the other loops of the same header
+struct Loop {
+  Block *header;
+  // The blocks of the loop including the header
+  std::set<Block *> body;
+  // The only predecessor of the header outside the loop, which continues with the header only
+  Block *preheader;
+
+  bool Contains(Instruction const *value) const { return body.count(value->block) > 0; }
+};
+
+// Returns the dominators of each block reachable from the entry
+std::map<Block const *, std::set<Block const *>> dominators(Function const &function) {
+  std::map<Block const *, std::set<Block const *>> result;
+  std::set<Block const *> all;
+  for (auto const &block : function.blocks) all.insert(&block);
+  for (auto const &block : function.blocks) result[&block] = all;
+  auto entry = &function.blocks.front();
+  result[entry] = {entry};
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (auto const &block : function.blocks) {
+      if (&block == entry) continue;
+      std::set<Block const *> dominating = all;
+      for (auto predecessor : block.predecessors) {
+        std::set<Block const *> common;
+        auto const &other = result[predecessor];
+        std::set_intersection(dominating.begin(), dominating.end(), other.begin(), other.end(),
+                              std::inserter(common, common.end()));
+        dominating.swap(common);
+      }
+      dominating.insert(&block);
+      if (dominating != result[&block]) {
+        result[&block].swap(dominating);
+        changed = true;
+      }
+    }
+  }
+  return result;
+}
+
+// Returns the loops having a preheader, inner loops first. The loops built from while statements always have one.
+std::vector<Loop> find_loops(Function *function) {
+  auto const dominating = dominators(*function);
+  std::map<Block *, Loop> loops;
+  for (auto &block : function->blocks) {
+    for (auto header : block.Successors()) {
+      if (dominating.at(&block).count(header) == 0) continue;
+      auto &loop = loops[header];
+      loop.header = header;
+      loop.body.insert(header);
+      // Everything reaching the back edge without passing the header
+      std::vector<Block *> pending = {&block};
+      while (!pending.empty()) {
+        auto member = pending.back();
+        pending.pop_back();
+        if (!loop.body.insert(member).second) continue;
+        for (auto predecessor : member->predecessors) pending.push_back(predecessor);
+      }
+    }
+  }
+  std::vector<Loop> result;
+  for (auto &entry : loops) {
+    auto &loop = entry.second;
+    loop.preheader = nullptr;
+    for (auto predecessor : loop.header->predecessors) {
+      if (loop.body.count(predecessor) > 0) continue;
+      if (loop.preheader != nullptr) {
+        loop.preheader = nullptr;
+        break;
+      }
+      loop.preheader = predecessor;
+    }
+    if (loop.preheader == nullptr || loop.preheader->Successors().size() != 1) continue;
+    result.push_back(loop);
+  }
+  std::stable_sort(result.begin(), result.end(),
+                   [](Loop const &a, Loop const &b) { return a.body.size() < b.body.size(); });
+  return result;
+}
+
+// Moves the instruction in front of the terminator of the preheader
+void hoist(Instruction *instruction, Block *preheader) {
+  auto source = instruction->block;
+  auto position = std::find_if(source->instructions.begin(), source->instructions.end(),
+                               [instruction](Instruction const &candidate) { return &candidate == instruction; });
+  preheader->instructions.splice(std::prev(preheader->instructions.end()), source->instructions, position);
+  instruction->block = preheader;
+}
+
+class HoistLoopInvariants : public Pass {
+ public:
+  const char *Name() const override { return "hoist-loop-invariants"; }
+
+  bool Run(Function *function) override {
+    bool changed = false;
+    // The instructions hoisted out of an inner loop get considered for the outer one afterwards
+    for (auto const &loop : find_loops(function)) changed |= run(loop);
+    return changed;
+  }
+
+ private:
+  static bool run(Loop const &loop) {
+    // Global variables written in the loop. Any called function may write all of them.
+    std::set<int> stored;
+    bool calls = false;
+    for (auto block : loop.body) {
+      for (auto const &instruction : block->instructions) {
+        if (instruction.opcode == Opcode::Store) stored.insert(instruction.immediate);
+        calls |= instruction.opcode == Opcode::Call || instruction.opcode == Opcode::CallEx;
+      }
+    }
+    auto movable = [&](Instruction const &instruction) {
+      switch (instruction.opcode) {
+        case Opcode::Constant:
+          return true;
+        case Opcode::Load:
+          return !calls && stored.count(instruction.immediate) == 0;
+        default:
+          return (IsArithmetic(instruction.opcode) || IsComparison(instruction.opcode)) &&
+                 !instruction.HasSideEffects();
+      }
+    };
+
+    // Candidates in an order in which each one follows its operands
+    std::vector<Instruction *> candidates;
+    std::set<Instruction const *> invariant;
+    for (bool found = true; found;) {
+      found = false;
+      for (auto block : loop.body) {
+        for (auto &instruction : block->instructions) {
+          if (invariant.count(&instruction) > 0 || !movable(instruction)) continue;
+          if (!std::all_of(instruction.operands.begin(), instruction.operands.end(), [&](Instruction const *operand) {
+                return !loop.Contains(operand) || invariant.count(operand) > 0;
+              }))
+            continue;
+          invariant.insert(&instruction);
+          candidates.push_back(&instruction);
+          found = true;
+        }
+      }
+    }
+
+    // Reading a global variable costs nothing if the reading instruction stays next to its users. So keep the loads
+    // whose users stay in the loop, and with them the instructions using the loads.
+    std::map<Instruction const *, std::vector<Instruction const *>> users;
+    for (auto block : loop.body) {
+      for (auto const &instruction : block->instructions) {
+        for (auto operand : instruction.operands) users[operand].push_back(&instruction);
+      }
+    }
+    for (bool dropped = true; dropped;) {
+      dropped = false;
+      for (auto candidate : candidates) {
+        if (invariant.count(candidate) == 0) continue;
+        bool keep;
+        if (candidate->opcode == Opcode::Load) {
+          auto const &uses = users[candidate];
+          keep = std::all_of(uses.begin(), uses.end(), [&](Instruction const *user) { return invariant.count(user); });
+        } else {
+          keep = std::all_of(candidate->operands.begin(), candidate->operands.end(), [&](Instruction const *operand) {
+            return !loop.Contains(operand) || invariant.count(operand) > 0;
+          });
+        }
+        if (keep) continue;
+        invariant.erase(candidate);
+        dropped = true;
+      }
+    }
+
+    bool changed = false;
+    for (auto candidate : candidates) {
+      if (invariant.count(candidate) == 0) continue;
+      hoist(candidate, loop.preheader);
+      changed = true;
+    }
+    return changed;
+  }
+};
+
+class ReduceStrength : public Pass {
+ public:
+  const char *Name() const override { return "reduce-strength"; }
+
+  bool Run(Function *function) override {
+    bool changed = false;
+    for (auto const &loop : find_loops(function)) changed |= run(function, loop);
+    return changed;
+  }
+
+ private:
+  // Induction variable: a phi of the header which gets increased or decreased by a value invariant in the loop on
+  // each back edge
+  struct Induction {
+    Instruction *phi;
+    // The operand of the phi from the preheader
+    Instruction *initial;
+    // The operands of the phi from the back edges. Adding or substracting the step from the phi.
+    std::vector<Instruction *> steps;
+  };
+
+  static bool run(Function *function, Loop const &loop) {
+    auto const entry = loop.header->PredecessorIndex(loop.preheader);
+    std::map<Instruction const *, Induction> inductions;
+    for (auto &phi : loop.header->instructions) {
+      if (phi.opcode != Opcode::Phi) break;
+      Induction induction{&phi, phi.operands[entry], {}};
+      for (size_t i = 0; i < phi.operands.size(); ++i) {
+        if (static_cast<int>(i) == entry) continue;
+        auto step = phi.operands[i];
+        if (!is_step(loop, phi, *step)) {
+          induction.phi = nullptr;
+          break;
+        }
+        induction.steps.push_back(step);
+      }
+      if (induction.phi != nullptr) inductions.emplace(&phi, induction);
+    }
+    if (inductions.empty()) return false;
+
+    bool changed = false;
+    auto const terminator = std::prev(loop.preheader->instructions.end());
+    for (auto block : loop.body) {
+      for (auto &instruction : block->instructions) {
+        if (instruction.opcode != Opcode::Multiply) continue;
+        auto variable = instruction.operands[0], factor = instruction.operands[1];
+        if (inductions.count(variable) == 0) std::swap(variable, factor);
+        if (inductions.count(variable) == 0 || loop.Contains(factor)) continue;
+        auto const &induction = inductions.at(variable);
+
+        // variable * factor changes by step * factor with each step of the variable
+        auto reduced = function->Insert(loop.header, loop.header->instructions.begin(), Opcode::Phi);
+        reduced->operands.resize(loop.header->predecessors.size());
+        auto initial = function->Insert(loop.preheader, terminator, Opcode::Multiply);
+        initial->operands = {induction.initial, factor};
+        reduced->operands[entry] = initial;
+        std::map<Instruction const *, Instruction *> next;
+        for (auto step : induction.steps) {
+          if (next.count(step) > 0) continue;
+          auto distance = function->Insert(loop.preheader, terminator, Opcode::Multiply);
+          distance->operands = {step->operands[step->operands[0] == variable ? 1 : 0], factor};
+          auto position = std::find_if(step->block->instructions.begin(), step->block->instructions.end(),
+                                       [step](Instruction const &candidate) { return &candidate == step; });
+          auto advanced = function->Insert(step->block, std::next(position), step->opcode);
+          advanced->operands = {reduced, distance};
+          next[step] = advanced;
+        }
+        for (size_t i = 0, k = 0; i < reduced->operands.size(); ++i) {
+          if (static_cast<int>(i) != entry) reduced->operands[i] = next[induction.steps[k++]];
+        }
+        function->ReplaceUses(&instruction, reduced);
+        changed = true;
+      }
+    }
+    return changed;
+  }
+
+  // Whether "step" is phi + invariant, invariant + phi or phi - invariant
+  static bool is_step(Loop const &loop, Instruction const &phi, Instruction const &step) {
+    if (step.opcode != Opcode::Add && step.opcode != Opcode::Substract) return false;
+    auto a = step.operands[0], b = step.operands[1];
+    if (a == &phi) return !loop.Contains(b);
+    return step.opcode == Opcode::Add && b == &phi && !loop.Contains(a);
+  }
+};
+
+}  // namespace
+
+std::unique_ptr<Pass> CreateHoistLoopInvariants() { return std::make_unique<HoistLoopInvariants>(); }
+
+std::unique_ptr<Pass> CreateReduceStrength() { return std::make_unique<ReduceStrength>(); }
+
+}  // namespace charlie::program::ir
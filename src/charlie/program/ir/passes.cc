@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "passes.h"
+
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include <utility>
+
+#include "../constant_folding.h"
+
+namespace charlie::program::ir {
+
+namespace {
+
+inline bool is_constant(Instruction const *value, int constant) {
+  return value->opcode == Opcode::Constant && value->immediate == constant;
+}
+
+// Turns the instruction into a constant. Its operands stay unchanged.
+inline void make_constant(Instruction *instruction, int value) {
+  instruction->opcode = Opcode::Constant;
+  instruction->immediate = value;
+  instruction->operands.clear();
+}
+
+class SimplifyPhis : public Pass {
+ public:
+  const char *Name() const override { return "simplify-phis"; }
+
+  bool Run(Function *function) override {
+    bool changed = false;
+    // Removing a phi may make the ones using it trivial
+    for (bool again = true; again;) {
+      again = false;
+      for (auto &block : function->blocks) {
+        for (auto it = block.instructions.begin(); it != block.instructions.end() && it->opcode == Opcode::Phi;) {
+          Instruction *same = nullptr;
+          bool trivial = true;
+          for (auto operand : it->operands) {
+            if (operand == &*it || operand == same) continue;
+            if (same != nullptr) {
+              trivial = false;
+              break;
+            }
+            same = operand;
+          }
+          if (!trivial || same == nullptr) {
+            ++it;
+            continue;
+          }
+          function->ReplaceUses(&*it, same);
+          it = block.instructions.erase(it);
+          again = changed = true;
+        }
+      }
+    }
+    return changed;
+  }
+};
+
+class FoldConstants : public Pass {
+ public:
+  const char *Name() const override { return "fold-constants"; }
+
+  bool Run(Function *function) override {
+    bool changed = false;
+    for (auto &block : function->blocks) {
+      for (auto &instruction : block.instructions) {
+        if (!IsArithmetic(instruction.opcode) && !IsComparison(instruction.opcode)) continue;
+        auto left = instruction.operands[0], right = instruction.operands[1];
+        int result;
+        if (left->opcode == Opcode::Constant && right->opcode == Opcode::Constant) {
+          if (!Evaluate(StackInstruction(instruction.opcode), left->immediate, right->immediate, &result)) continue;
+          make_constant(&instruction, result);
+          changed = true;
+          continue;
+        }
+        Instruction *same = nullptr;
+        switch (instruction.opcode) {
+          case Opcode::Add:
+            if (is_constant(right, 0)) same = left;
+            if (is_constant(left, 0)) same = right;
+            break;
+          case Opcode::Substract:
+            if (is_constant(right, 0)) same = left;
+            if (left == right) {
+              make_constant(&instruction, 0);
+              changed = true;
+            }
+            break;
+          case Opcode::Multiply:
+            if (is_constant(right, 1)) same = left;
+            if (is_constant(left, 1)) same = right;
+            if (is_constant(left, 0) || is_constant(right, 0)) {
+              make_constant(&instruction, 0);
+              changed = true;
+            }
+            break;
+          case Opcode::Divide:
+            if (is_constant(right, 1)) same = left;
+            break;
+          case Opcode::Equal:
+          case Opcode::GreaterEqual:
+          case Opcode::LessEqual:
+          case Opcode::NotEqual:
+          case Opcode::Greater:
+          case Opcode::Less:
+            if (left == right) {
+              const bool reflexive = instruction.opcode == Opcode::Equal ||
+                                     instruction.opcode == Opcode::GreaterEqual ||
+                                     instruction.opcode == Opcode::LessEqual;
+              make_constant(&instruction, reflexive ? 1 : 0);
+              changed = true;
+            }
+            break;
+          default:
+            break;
+        }
+        // The instruction gets removed as dead code
+        if (same != nullptr && instruction.opcode != Opcode::Constant) {
+          function->ReplaceUses(&instruction, same);
+          changed = true;
+        }
+      }
+    }
+    return changed;
+  }
+};
+
+class SimplifyControlFlow : public Pass {
+ public:
+  const char *Name() const override { return "simplify-control-flow"; }
+
+  bool Run(Function *function) override {
+    bool changed = false;
+    for (auto &block : function->blocks) {
+      auto terminator = block.Terminator();
+      if (terminator == nullptr || terminator->opcode != Opcode::Branch ||
+          terminator->operands[0]->opcode != Opcode::Constant)
+        continue;
+      const bool holds = terminator->operands[0]->immediate != 0;
+      auto taken = terminator->targets[holds ? 0 : 1], other = terminator->targets[holds ? 1 : 0];
+      if (taken != other) Function::RemoveEdge(&block, other);
+      terminator->opcode = Opcode::Jump;
+      terminator->operands.clear();
+      terminator->targets = {taken};
+      changed = true;
+    }
+
+    // Remove the blocks which can not be reached from the entry
+    std::set<Block const *> reachable;
+    std::vector<Block *> pending = {&function->blocks.front()};
+    while (!pending.empty()) {
+      auto block = pending.back();
+      pending.pop_back();
+      if (!reachable.insert(block).second) continue;
+      for (auto successor : block->Successors()) pending.push_back(successor);
+    }
+    for (auto it = function->blocks.begin(); it != function->blocks.end();) {
+      if (reachable.count(&*it) > 0) {
+        ++it;
+        continue;
+      }
+      for (auto successor : it->Successors()) Function::RemoveEdge(&*it, successor);
+      it = function->blocks.erase(it);
+      changed = true;
+    }
+
+    for (auto it = function->blocks.begin(); it != function->blocks.end();) {
+      if (merge(function, &*it)) {
+        changed = true;
+      } else {
+        ++it;
+      }
+    }
+    return changed;
+  }
+
+ private:
+  // Appends the only successor of the block if the block is its only predecessor
+  static bool merge(Function *function, Block *block) {
+    auto terminator = block->Terminator();
+    if (terminator == nullptr || terminator->opcode != Opcode::Jump) return false;
+    auto successor = terminator->targets[0];
+    if (successor == block || successor == &function->blocks.front() || successor->predecessors.size() != 1)
+      return false;
+    while (!successor->instructions.empty() && successor->instructions.front().opcode == Opcode::Phi) {
+      auto &phi = successor->instructions.front();
+      function->ReplaceUses(&phi, phi.operands[0]);
+      successor->instructions.pop_front();
+    }
+    block->instructions.pop_back();
+    for (auto &instruction : successor->instructions) instruction.block = block;
+    block->instructions.splice(block->instructions.end(), successor->instructions);
+    for (auto next : block->Successors()) {
+      std::replace(next->predecessors.begin(), next->predecessors.end(), successor, block);
+    }
+    function->blocks.remove_if([successor](Block const &candidate) { return &candidate == successor; });
+    return true;
+  }
+};
+
+class EliminateDeadCode : public Pass {
+ public:
+  const char *Name() const override { return "eliminate-dead-code"; }
+
+  bool Run(Function *function) override {
+    // Mark the instructions the side effects depend on, which also removes unused cycles of phis
+    std::set<Instruction const *> live;
+    std::vector<Instruction const *> pending;
+    for (auto const &block : function->blocks) {
+      for (auto const &instruction : block.instructions) {
+        if (instruction.HasSideEffects()) pending.push_back(&instruction);
+      }
+    }
+    while (!pending.empty()) {
+      auto instruction = pending.back();
+      pending.pop_back();
+      if (!live.insert(instruction).second) continue;
+      for (auto operand : instruction->operands) pending.push_back(operand);
+    }
+    bool changed = false;
+    for (auto &block : function->blocks) {
+      const size_t size = block.instructions.size();
+      block.instructions.remove_if([&live](Instruction const &instruction) { return live.count(&instruction) == 0; });
+      changed |= block.instructions.size() != size;
+    }
+    return changed;
+  }
+};
+
+class EvaluateCalls : public Pass {
+ public:
+  explicit EvaluateCalls(CallEvaluator evaluator) : evaluator_(std::move(evaluator)) {}
+
+  const char *Name() const override { return "evaluate-calls"; }
+
+  bool Run(Function *function) override {
+    bool changed = false;
+    for (auto &block : function->blocks) {
+      for (auto &instruction : block.instructions) {
+        if (instruction.opcode != Opcode::Call || !instruction.has_image) continue;
+        std::vector<int> arguments;
+        for (auto operand : instruction.operands) {
+          if (operand->opcode != Opcode::Constant) break;
+          arguments.push_back(operand->immediate);
+        }
+        int result;
+        if (arguments.size() != instruction.operands.size() ||
+            !evaluator_(instruction.immediate, arguments, &result))
+          continue;
+        make_constant(&instruction, result);
+        changed = true;
+      }
+    }
+    return changed;
+  }
+
+ private:
+  CallEvaluator evaluator_;
+};
+
+}  // namespace
+
+PassManager::PassManager() : passes_() {}
+
+PassManager PassManager::Default() {
+  PassManager manager;
+  manager.Add(CreateSimplifyPhis());
+  manager.Add(CreateFoldConstants());
+  manager.Add(CreateSimplifyControlFlow());
+  // Invariant steps and factors have been hoisted before the strength reduction looks for them
+  manager.Add(CreateHoistLoopInvariants());
+  manager.Add(CreateReduceStrength());
+  manager.Add(CreateEliminateDeadCode());
+  return manager;
+}
+
+void PassManager::Add(std::unique_ptr<Pass> pass) { passes_.push_back(std::move(pass)); }
+
+int PassManager::Run(Function *function, std::ostream *trace) const {
+  int round = 0;
+  for (bool changed = true; changed && round < kMaxRounds; ++round) {
+    changed = false;
+    for (auto const &pass : passes_) {
+      if (!pass->Run(function)) continue;
+      changed = true;
+      if (trace != nullptr) *trace << "; after " << pass->Name() << "\n" << *function;
+    }
+  }
+  return round;
+}
+
+std::unique_ptr<Pass> CreateSimplifyPhis() { return std::make_unique<SimplifyPhis>(); }
+
+std::unique_ptr<Pass> CreateFoldConstants() { return std::make_unique<FoldConstants>(); }
+
+std::unique_ptr<Pass> CreateSimplifyControlFlow() { return std::make_unique<SimplifyControlFlow>(); }
+
+std::unique_ptr<Pass> CreateEliminateDeadCode() { return std::make_unique<EliminateDeadCode>(); }
+
+std::unique_ptr<Pass> CreateEvaluateCalls(CallEvaluator evaluator) {
+  return std::make_unique<EvaluateCalls>(std::move(evaluator));
+}
+
+}  // namespace charlie::program::ir
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef CHARLIE_PROGRAM_IR_PASSES_H
+#define CHARLIE_PROGRAM_IR_PASSES_H
+
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "ir.h"
+
+namespace charlie::program::ir {
+
+// Transformation of a function in SSA form
+class Pass {
+ public:
+  virtual ~Pass() = default;
+  // Name in the textual form
+  virtual const char *Name() const = 0;
+  // Returns true if the function changed
+  virtual bool Run(Function *function) = 0;
+};
+
+// Runs a sequence of passes until none of them changes the function anymore.
+class PassManager {
+ public:
+  PassManager();
+  // Creates a manager running the passes which clean up after the construction and after each other
+  static PassManager Default();
+  void Add(std::unique_ptr<Pass> pass);
+  // If "trace" is not null, the name of each pass which changed the function gets written to it together with the
+  // resulting function. Returns the number of rounds.
+  int Run(Function *function, std::ostream *trace = nullptr) const;
+
+ private:
+  static const int kMaxRounds = 8;
+  std::vector<std::unique_ptr<Pass>> passes_;
+};
+
+// Calculates the result of calling the function with the index "function" on the arguments. Returns false if the call
+// has to stay.
+typedef std::function<bool(int function, std::vector<int> const &arguments, int *result)> CallEvaluator;
+
+// Replaces phis whose operands are all the same value, besides the phi itself, by that value.
+std::unique_ptr<Pass> CreateSimplifyPhis();
+// Replaces operations on constants by their result, and algebraic identities like x + 0 and x * 1 by their operand.
+std::unique_ptr<Pass> CreateFoldConstants();
+// Turns branches on constants into jumps, removes unreachable blocks and merges a block into its only predecessor if
+// it is the only successor of that.
+std::unique_ptr<Pass> CreateSimplifyControlFlow();
+// Removes the instructions whose values are not used and which have no side effects.
+std::unique_ptr<Pass> CreateEliminateDeadCode();
+// Moves the operations of a loop whose operands do not change in it in front of the loop. Global variables count as
+// unchanged if the loop neither writes them nor calls functions. Their loads stay in the loop if any use stays there.
+std::unique_ptr<Pass> CreateHoistLoopInvariants();
+// Replaces the product of an induction variable of a loop and a value not changing in it by a new induction variable,
+// which gets increased by the product of the step and that value whenever the old one gets increased.
+std::unique_ptr<Pass> CreateReduceStrength();
+// Replaces the calls of functions with constant arguments by the result the evaluator calculates for them.
+std::unique_ptr<Pass> CreateEvaluateCalls(CallEvaluator evaluator);
+
+}  // namespace charlie::program::ir
+
+#endif  // !CHARLIE_PROGRAM_IR_PASSES_H
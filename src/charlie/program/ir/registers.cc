@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "registers.h"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace charlie::program::ir {
+
+namespace {
+
+class Allocator {
+ public:
+  Allocator(Function *function, int base)
+      : function_(function), base_(base), users_(), live_out_(), neighbors_(), parents_(), members_() {}
+
+  void Run() {
+    split_critical_edges();
+    isolate_phis();
+    collect_users();
+    use_globals();
+    analyze_liveness();
+    build_interference();
+    coalesce();
+    assign();
+  }
+
+ private:
+  // Values which need a register slot in the frame
+  static bool needs_slot(Instruction const *value) {
+    return value->HasValue() && value->opcode != Opcode::Constant && value->address < 0;
+  }
+
+  // The copies of a phi can not be placed on an edge whose source has another successor
+  void split_critical_edges() {
+    for (auto &block : function_->blocks) {
+      if (block.instructions.empty() || block.instructions.front().opcode != Opcode::Phi) continue;
+      const auto predecessors = block.predecessors;
+      for (auto predecessor : predecessors) {
+        if (predecessor->Successors().size() > 1) function_->SplitEdge(predecessor, &block);
+      }
+    }
+  }
+
+  // Copies each operand of a phi at the end of its predecessor and the phi itself behind the phis of its block.
+  // Then the live ranges of a phi and its operands do not overlap, see Sreedhar et al.: "Translating Out of Static
+  // Single Assignment Form". The copies which turn out to be unnecessary get coalesced later.
+  void isolate_phis() {
+    for (auto &block : function_->blocks) {
+      std::vector<Instruction *> phis;
+      auto position = block.instructions.begin();
+      for (; position != block.instructions.end() && position->opcode == Opcode::Phi; ++position) {
+        phis.push_back(&*position);
+      }
+      for (auto phi : phis) {
+        for (size_t i = 0; i < phi->operands.size(); ++i) {
+          auto predecessor = block.predecessors[i];
+          auto copy = function_->Insert(predecessor, std::prev(predecessor->instructions.end()), Opcode::Copy);
+          copy->operands.push_back(phi->operands[i]);
+          phi->operands[i] = copy;
+          join(phi, copy);
+        }
+        auto copy = function_->Insert(&block, position, Opcode::Copy);
+        function_->ReplaceUses(phi, copy);
+        copy->operands.push_back(phi);
+      }
+    }
+  }
+
+  void collect_users() {
+    for (auto &block : function_->blocks) {
+      for (auto &instruction : block.instructions) {
+        for (auto operand : instruction.operands) users_[operand].push_back(&instruction);
+      }
+    }
+  }
+
+  // Loads read the global variable directly and values which get stored right away are calculated into it
+  void use_globals() {
+    for (auto &block : function_->blocks) {
+      for (auto it = block.instructions.begin(); it != block.instructions.end(); ++it) {
+        if (it->opcode == Opcode::Load) {
+          // All uses have to follow in the block before the variable may change
+          size_t uses = 0;
+          for (auto next = std::next(it); next != block.instructions.end(); ++next) {
+            uses += std::count(next->operands.begin(), next->operands.end(), &*it);
+            if (next->opcode == Opcode::Call || next->opcode == Opcode::CallEx ||
+                (next->opcode == Opcode::Store && next->immediate == it->immediate))
+              break;
+          }
+          if (uses == users_[&*it].size()) it->address = it->immediate;
+        } else if (it->opcode == Opcode::Store && it != block.instructions.begin()) {
+          auto value = &*std::prev(it);
+          if (it->operands[0] == value && needs_slot(value) && value->opcode != Opcode::Phi &&
+              users_[value].size() == 1)
+            value->address = it->immediate;
+        }
+      }
+    }
+  }
+
+  void analyze_liveness() {
+    std::map<Block const *, std::set<Instruction *>> live_in;
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (auto block = function_->blocks.rbegin(); block != function_->blocks.rend(); ++block) {
+        std::set<Instruction *> live;
+        for (auto successor : block->Successors()) {
+          auto const &in = live_in[successor];
+          live.insert(in.begin(), in.end());
+          // The operands of phis are live at the end of the belonging predecessor
+          const int index = successor->PredecessorIndex(&*block);
+          for (auto &phi : successor->instructions) {
+            if (phi.opcode != Opcode::Phi) break;
+            if (needs_slot(phi.operands[index])) live.insert(phi.operands[index]);
+          }
+        }
+        live_out_[&*block] = live;
+        for (auto it = block->instructions.rbegin(); it != block->instructions.rend(); ++it) {
+          live.erase(&*it);
+          if (it->opcode == Opcode::Phi) continue;
+          for (auto operand : it->operands) {
+            if (needs_slot(operand)) live.insert(operand);
+          }
+        }
+        auto &in = live_in[&*block];
+        if (in != live) {
+          in = live;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  void build_interference() {
+    for (auto &block : function_->blocks) {
+      auto live = live_out_[&block];
+      auto it = block.instructions.rbegin();
+      for (; it != block.instructions.rend() && it->opcode != Opcode::Phi; ++it) {
+        if (needs_slot(&*it)) {
+          for (auto other : live) {
+            // A copy may share the slot of its source
+            if (it->opcode == Opcode::Copy && it->operands[0] == other) continue;
+            interfere(&*it, other);
+          }
+          live.erase(&*it);
+        }
+        for (auto operand : it->operands) {
+          if (needs_slot(operand)) live.insert(operand);
+        }
+      }
+      // The phis get defined at once at the entry of the block
+      for (; it != block.instructions.rend(); ++it) live.insert(&*it);
+      for (auto phi : live) {
+        if (phi->opcode != Opcode::Phi || phi->block != &block) continue;
+        for (auto other : live) interfere(phi, other);
+      }
+    }
+  }
+
+  void interfere(Instruction *a, Instruction *b) {
+    if (a == b) return;
+    neighbors_[a].insert(b);
+    neighbors_[b].insert(a);
+  }
+
+  Instruction *find(Instruction *value) {
+    auto it = parents_.find(value);
+    if (it == parents_.end() || it->second == value) return value;
+    return it->second = find(it->second);
+  }
+
+  void join(Instruction *a, Instruction *b) {
+    a = find(a);
+    b = find(b);
+    if (a == b) return;
+    auto &members_a = members_[a], &members_b = members_[b];
+    if (members_a.empty()) members_a.push_back(a);
+    if (members_b.empty()) members_b.push_back(b);
+    if (members_a.size() < members_b.size()) std::swap(a, b);
+    parents_[b] = a;
+    members_[a].insert(members_[a].end(), members_[b].begin(), members_[b].end());
+    members_.erase(b);
+  }
+
+  std::vector<Instruction *> const &members(Instruction *root) {
+    auto &members = members_[root];
+    if (members.empty()) members.push_back(root);
+    return members;
+  }
+
+  bool interfere_classes(Instruction *a, Instruction *b) {
+    for (auto member : members(a)) {
+      for (auto neighbor : neighbors_[member]) {
+        if (find(neighbor) == b) return true;
+      }
+    }
+    return false;
+  }
+
+  void coalesce() {
+    for (auto &block : function_->blocks) {
+      for (auto &instruction : block.instructions) {
+        if (instruction.opcode != Opcode::Copy || !needs_slot(&instruction) || !needs_slot(instruction.operands[0]))
+          continue;
+        auto a = find(&instruction), b = find(instruction.operands[0]);
+        if (a != b && !interfere_classes(a, b)) join(a, b);
+      }
+    }
+  }
+
+  // Gives each class the lowest slot none of its neighbors has
+  void assign() {
+    std::map<Instruction const *, int> slots;
+    int frame_size = 0;
+    for (auto &block : function_->blocks) {
+      for (auto &instruction : block.instructions) {
+        if (!needs_slot(&instruction)) continue;
+        auto root = find(&instruction);
+        auto assigned = slots.find(root);
+        if (assigned == slots.end()) {
+          std::set<int> taken;
+          for (auto member : members(root)) {
+            for (auto neighbor : neighbors_[member]) {
+              auto slot = slots.find(find(neighbor));
+              if (slot != slots.end()) taken.insert(slot->second);
+            }
+          }
+          int slot = 0;
+          while (taken.count(slot) > 0) ++slot;
+          assigned = slots.insert({root, slot}).first;
+          frame_size = std::max(frame_size, slot + 1);
+        }
+        instruction.address = base_ + assigned->second;
+      }
+    }
+    function_->frame_size = frame_size;
+  }
+
+  Function *function_;
+  const int base_;
+  std::map<Instruction const *, std::vector<Instruction *>> users_;
+  std::map<Block const *, std::set<Instruction *>> live_out_;
+  // Interference graph
+  std::map<Instruction const *, std::set<Instruction *>> neighbors_;
+  // Classes of values sharing a slot as union-find
+  std::map<Instruction *, Instruction *> parents_;
+  std::map<Instruction *, std::vector<Instruction *>> members_;
+};
+
+}  // namespace
+
+void AssignRegisters(Function *function, int base) {
+  Allocator allocator(function, base);
+  allocator.Run();
+}
+
+}  // namespace charlie::program::ir
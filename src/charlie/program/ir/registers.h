@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef CHARLIE_PROGRAM_IR_REGISTERS_H
+#define CHARLIE_PROGRAM_IR_REGISTERS_H
+
+#include "ir.h"
+
+namespace charlie::program::ir {
+
+// Leaves the SSA form for the code generation: Copies at the end of the predecessors of each phi provide its operands
+// at the address of the phi, so the phis themselves need no code. Each value gets a register address in the frame of
+// the function, which begins at "base". Values whose live ranges do not overlap share an address, and copies whose
+// source and destination end up at the same address become obsolete.
+// A load of a global variable uses the address of the variable itself while the variable does not change, and the
+// value a store writes gets calculated into the global variable directly if the store follows it.
+// Sets Instruction::address of each value besides constants, and Function::frame_size.
+void AssignRegisters(Function *function, int base);
+
+}  // namespace charlie::program::ir
+
+#endif  // !CHARLIE_PROGRAM_IR_REGISTERS_H
@@ -55,7 +55,7 @@ class Mapping {
   };
 
   struct Location {
-    Location() {}
+    Location() : filename_id(0), line(0), column(0) {}
     Location(int line, int column) : line(line), column(column) {}
     int filename_id;
     int line;
@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "peephole.h"
+
+#include <iterator>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "../vm/instruction.h"
+
+namespace charlie::program {
+
+using vm::InstructionEnums;
+using vm::InstructionManager;
+
+namespace {
+
+struct Instruction {
+  // Address in the original bytecode
+  int address;
+  int code;
+  std::vector<int> operands;
+};
+
+inline bool is_arithmetic(int code) { return code >= InstructionEnums::IntAdd && code <= InstructionEnums::IntModulo; }
+
+inline bool is_comparison(int code) {
+  return code >= InstructionEnums::IntEqual && code <= InstructionEnums::IntLessEqual;
+}
+
+inline bool is_commutative(int code) {
+  return code == InstructionEnums::IntAdd || code == InstructionEnums::IntMultiply;
+}
+
+// Replaces the last "count" instructions with the fused instruction.
+void replace_tail(std::vector<Instruction> *code, int count, int fused, std::vector<int> operands) {
+  const int address = (*code)[code->size() - count].address;
+  code->resize(code->size() - count);
+  code->push_back({address, fused, std::move(operands)});
+}
+
+// Fuses the sequence at the end of the code if it matches one of the patterns.
+// None of the instructions but the first may be a jump target.
+// Returns true if the sequence got replaced.
+bool fuse_tail(std::vector<Instruction> *code, std::set<int> const &targets) {
+  const int size = static_cast<int>(code->size());
+  // Returns the instruction "back" positions before the end or nullptr if it is not part of the sequence
+  auto at = [&](int back, int count) -> const Instruction * {
+    if (count > size) return nullptr;
+    const Instruction &instruction = (*code)[size - back];
+    if (back < count && targets.count(instruction.address) > 0) return nullptr;
+    return &instruction;
+  };
+
+  // Push a; Push b; IntLess; JumpIfZero else -> JumpIfIntGreaterEqualRR a b else
+  auto jump = at(1, 4);
+  if (jump != nullptr && jump->code == InstructionEnums::JumpIfZero) {
+    auto comparison = at(2, 4), b = at(3, 4), a = at(4, 4);
+    if (comparison && b && a && is_comparison(comparison->code)) {
+      // JumpIfZero jumps if the condition does not hold
+      const int condition = InstructionManager::NegateComparison(comparison->code);
+      const int target = jump->operands[0];
+      if (a->code == InstructionEnums::Push && b->code == InstructionEnums::Push) {
+        replace_tail(code, 4, InstructionEnums::JumpIfIntEqualRR + condition - InstructionEnums::IntEqual,
+                     {a->operands[0], b->operands[0], target});
+        return true;
+      }
+      if (a->code == InstructionEnums::Push && b->code == InstructionEnums::PushConst) {
+        replace_tail(code, 4, InstructionEnums::JumpIfIntEqualRI + condition - InstructionEnums::IntEqual,
+                     {a->operands[0], b->operands[0], target});
+        return true;
+      }
+      if (a->code == InstructionEnums::PushConst && b->code == InstructionEnums::Push) {
+        const int mirrored = InstructionManager::MirrorComparison(condition);
+        replace_tail(code, 4, InstructionEnums::JumpIfIntEqualRI + mirrored - InstructionEnums::IntEqual,
+                     {b->operands[0], a->operands[0], target});
+        return true;
+      }
+    }
+  }
+
+  // Push a; Push b; IntAdd -> PushIntAddRR a b
+  auto op = at(1, 3);
+  if (op != nullptr && is_arithmetic(op->code)) {
+    auto b = at(2, 3), a = at(3, 3);
+    if (a && b) {
+      const int offset = op->code - InstructionEnums::IntAdd;
+      if (a->code == InstructionEnums::Push && b->code == InstructionEnums::Push) {
+        replace_tail(code, 3, InstructionEnums::PushIntAddRR + offset, {a->operands[0], b->operands[0]});
+        return true;
+      }
+      if (a->code == InstructionEnums::Push && b->code == InstructionEnums::PushConst) {
+        replace_tail(code, 3, InstructionEnums::PushIntAddRI + offset, {a->operands[0], b->operands[0]});
+        return true;
+      }
+      if (a->code == InstructionEnums::PushConst && b->code == InstructionEnums::Push && is_commutative(op->code)) {
+        replace_tail(code, 3, InstructionEnums::PushIntAddRI + offset, {b->operands[0], a->operands[0]});
+        return true;
+      }
+    }
+  }
+
+  // Push a; IntCopy d -> MoveRR d a
+  auto copy = at(1, 2);
+  if (copy != nullptr && copy->code == InstructionEnums::IntCopy) {
+    auto value = at(2, 2);
+    if (value == nullptr) return false;
+    const int destination = copy->operands[0];
+    if (value->code == InstructionEnums::Push) {
+      replace_tail(code, 2, InstructionEnums::MoveRR, {destination, value->operands[0]});
+      return true;
+    }
+    if (value->code == InstructionEnums::PushConst) {
+      replace_tail(code, 2, InstructionEnums::MoveRI, {destination, value->operands[0]});
+      return true;
+    }
+    if (value->code >= InstructionEnums::PushIntAddRR && value->code <= InstructionEnums::PushIntModuloRR) {
+      replace_tail(code, 2, value->code - InstructionEnums::PushIntAddRR + InstructionEnums::IntAddRRR,
+                   {destination, value->operands[0], value->operands[1]});
+      return true;
+    }
+    if (value->code >= InstructionEnums::PushIntAddRI && value->code <= InstructionEnums::PushIntModuloRI) {
+      replace_tail(code, 2, value->code - InstructionEnums::PushIntAddRI + InstructionEnums::IntAddRRI,
+                   {destination, value->operands[0], value->operands[1]});
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+int FuseInstructions(UnresolvedProgram *program, Mapping *mapping) {
+  auto &bytecode = program->instructions;
+  if (bytecode.empty()) return 0;
+  const int end = static_cast<int>(bytecode.size()) - 1;
+
+  // Decode the bytecode (without the version)
+  std::vector<Instruction> code;
+  for (int index = 1; index < static_cast<int>(bytecode.size());) {
+    const int count = InstructionManager::GetOperandCount(bytecode[index]);
+    if (count < 0 || index + count >= static_cast<int>(bytecode.size())) return 0;
+    code.push_back({index - 1, bytecode[index], std::vector<int>(bytecode.begin() + index + 1,
+                                                                 bytecode.begin() + index + 1 + count)});
+    index += count + 1;
+  }
+
+  std::set<int> targets;
+  for (auto &instruction : code) {
+    const int target = InstructionManager::GetTargetOperand(instruction.code);
+    if (target > -1) targets.insert(instruction.operands[target]);
+  }
+
+  // Fuse
+  int fused = 0;
+  std::vector<Instruction> result;
+  result.reserve(code.size());
+  for (auto &instruction : code) {
+    result.push_back(std::move(instruction));
+    while (fuse_tail(&result, targets)) ++fused;
+  }
+  if (fused == 0) return 0;
+
+  // Encode and remember the new address of each remaining instruction
+  std::map<int, int> addresses;
+  std::vector<int> fused_bytecode = {bytecode[0]};
+  for (auto &instruction : result) {
+    addresses[instruction.address] = static_cast<int>(fused_bytecode.size()) - 1;
+    fused_bytecode.push_back(instruction.code);
+    fused_bytecode.insert(fused_bytecode.end(), instruction.operands.begin(), instruction.operands.end());
+  }
+  const int fused_end = static_cast<int>(fused_bytecode.size()) - 1;
+  // Addresses inside of a fused sequence move to the fused instruction
+  auto remap = [&](int address) {
+    if (address >= end) return fused_end + address - end;
+    auto it = addresses.upper_bound(address);
+    if (it == addresses.begin()) return address;
+    return std::prev(it)->second;
+  };
+
+  for (auto &instruction : result) {
+    const int target = InstructionManager::GetTargetOperand(instruction.code);
+    if (target < 0) continue;
+    fused_bytecode[remap(instruction.address) + 2 + target] = remap(instruction.operands[target]);
+  }
+  bytecode = std::move(fused_bytecode);
+
+  if (mapping != nullptr) {
+    for (auto &function : mapping->Functions) {
+      function->scope.begin = remap(function->scope.begin);
+      function->scope.end = remap(function->scope.end);
+    }
+    for (auto &scope : mapping->Scopes) {
+      scope->begin = remap(scope->begin);
+      scope->end = remap(scope->end);
+    }
+    // Keep the location of the first statement of a fused sequence
+    std::map<int, Mapping::Location> locations(mapping->Instructions.begin(), mapping->Instructions.end());
+    mapping->Instructions.clear();
+    for (auto &location : locations) mapping->Instructions.insert({remap(location.first), location.second});
+  }
+  return fused;
+}
+
+}  // namespace charlie::program
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef CHARLIE_PROGRAM_PEEPHOLE_H
+#define CHARLIE_PROGRAM_PEEPHOLE_H
+
+#include "mapping.h"
+#include "unresolved_program.h"
+
+namespace charlie::program {
+
+// Replaces frequent instruction sequences of the bytecode with fused instructions:
+//   Push a; Push b; IntAdd                     -> PushIntAddRR a b
+//   Push a; PushConst k; IntAdd                -> PushIntAddRI a k
+//   PushIntAddRR a b; IntCopy d                -> IntAddRRR d a b
+//   Push a; IntCopy d                          -> MoveRR d a
+//   Push a; PushConst k; IntLess; JumpIfZero e -> JumpIfIntGreaterEqualRI a k e
+// Sequences containing a jump target are kept. Jump targets, call targets and the addresses of the mapping
+// (which may be nullptr) get moved to the new positions.
+// Returns the number of fused sequences.
+int FuseInstructions(UnresolvedProgram *program, Mapping *mapping);
+
+}  // namespace charlie::program
+
+#endif  // !CHARLIE_PROGRAM_PEEPHOLE_H
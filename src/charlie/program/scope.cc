@@ -49,6 +49,17 @@ Scope::VariableInfo Scope::GetVariableInfo(VariableDeclaration const& dec) const
       },
       it->first.image_type);
 }
+Scope const* Scope::GetDeclaringScope(std::string const& name, int address) const {
+  for (auto scope = this; scope != nullptr; scope = scope->parent_) {
+    auto it = scope->variable_declarations_.find(VariableDeclaration(name, VariableDeclaration::TypeEnum::Length));
+    if (it == scope->variable_declarations_.end()) continue;
+    // Same offset as the one of GetVariableInfo
+    auto par = scope->parent_;
+    const int offset = par == nullptr ? it->second : it->second + par->ParentOffset() + par->num_variable_declarations;
+    if (offset == address) return scope;
+  }
+  return nullptr;
+}
 int Scope::AddVariableDec(VariableDeclaration const& dec) {
   variable_declarations_.insert(make_pair(dec, num_variable_declarations++));
   auto par = parent_;
@@ -81,6 +81,9 @@ class Scope {
   // Gets all the gathered information of specified variable declaration.
   // Returns invalid result iff nothing was found: VariableInfo(0, VariableDeclaration::TypeEnum::Length);
   VariableInfo GetVariableInfo(VariableDeclaration const& dec) const;
+  // Returns this scope or the parent scope which declares the variable "name" at the register address "address".
+  // Returns nullptr if there is none.
+  Scope const* GetDeclaringScope(std::string const& name, int address) const;
   // Adds a new variable declaration and returns its key in the storing map.
   int AddVariableDec(VariableDeclaration const& dec);
   // Returns the index position of the this scope in the VMs register.
@@ -31,7 +31,7 @@ namespace charlie {
 namespace program {
 
 UnresolvedProgram::UnresolvedProgram() :
-  instructions(), root(nullptr), function_declarations() {
+  instructions(), max_stack_depth(0), root(nullptr), function_declarations() {
 }
 
 void UnresolvedProgram::Dispose() {
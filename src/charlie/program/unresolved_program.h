@@ -49,6 +49,8 @@ class UnresolvedProgram {
   xprt void Dispose();
   // The bytecode
   std::vector<int> instructions;
+  // Maximum depth of the ALU stack any function (or the global initialisation) needs.
+  int max_stack_depth;
   // All function declarations
   std::list<FunctionDeclaration> function_declarations;
   // The root scope for the syntax tree
@@ -169,10 +169,11 @@ bool Scanner::Scan(string const &code) {
           continue;
         } else if (wordType == WordType::Bracket && code[codeInfo_.pos] == '{') {
           ++codeInfo_.pos;
-          auto dec = FunctionDeclaration(variableName, type, args, &program_->root);
+          // Nested scopes keep a pointer to the definition scope, so it must not move after scanning
+          program_->function_declarations.push_back(FunctionDeclaration(variableName, type, args, &program_->root));
+          auto &dec = program_->function_declarations.back();
           if (!getFunctionDefinition(&dec)) return false;
           dec.has_definition = true;
-          program_->function_declarations.push_back(dec);
           if (codeInfo_.pos == -1) return false;
 
         } else {
@@ -501,6 +502,8 @@ void Scanner::process_controlsequences(std::string *text) {
 
 bool Scanner::getFunctionDefinition(FunctionDeclaration *dec) {
   // Are Arguments declared?
+  // The caller pushes the arguments in order: Pop them in reverse order
+  auto pops = dec->definition.statements.end();
   for (auto it = dec->argument_types.begin(); it != dec->argument_types.end(); ++it) {
     dec->definition.AddVariableDec(*it);
     if (it->image_type == VariableDeclaration::Int) {
@@ -511,7 +514,7 @@ bool Scanner::getFunctionDefinition(FunctionDeclaration *dec) {
       auto pLa = new Label(it->name, CodePostion(codeInfo_.pos));
       try_get_type_of_variable(dec->definition, pLa);
       statement.arguments.push_back(pLa);
-      dec->definition.statements.push_back(statement);
+      pops = dec->definition.statements.insert(pops, statement);
     } else {
       ERROR_MESSAGE_MAKE_CODE_AND_POS("Unsupported type");
       return false;
@@ -751,13 +754,34 @@ bool Scanner::treeifyStatement(program::Scope const &scope, list<Statement> *lin
               ERROR_MESSAGE_WITH_POS_MAKE_CODE(st, itTemp->value->position.character_position);
               return false;
             }
-            functionNode.value->finished = true;
-            *statement = functionNode;
-            return true;
+            // Keep the call in place: It may be the operand of an operator
+            itMax->arguments.push_back(*arg);
+            itMax->value->finished = true;
           } else {
-            if (!treeifyStatement(scope, &functionNode.arguments, statement)) return false;
+            // Arguments are separated by the commas outside of nested brackets
+            std::list<Statement> argument;
+            int depth = 0;
+            for (auto it = functionNode.arguments.begin();; ++it) {
+              const bool last = it == functionNode.arguments.end();
+              if (last || (depth == 0 && it->value->token_type == Base::TokenTypeEnum::Comma)) {
+                if (argument.empty()) {
+                  ERROR_MESSAGE_WITH_POS_MAKE_CODE("Missing argument", itTemp->value->position.character_position);
+                  return false;
+                }
+                if (!treeifyStatement(scope, &argument, statement)) return false;
+                itMax->arguments.push_back(*statement);
+                argument.clear();
+                if (last) break;
+                delete it->value;
+                continue;
+              }
+              if (isBracketToken(it->value, Bracket::DirectionEnum::Opening, Bracket::KindEnum::Round))
+                ++depth;
+              else if (isBracketToken(it->value, Bracket::DirectionEnum::Closing, Bracket::KindEnum::Round))
+                --depth;
+              argument.push_back(*it);
+            }
             functionNode.value->finished = true;
-            itMax->arguments.push_back(*statement);
             itMax->value->finished = true;
           }
         }
@@ -788,7 +812,9 @@ bool Scanner::treeifyStatement(program::Scope const &scope, list<Statement> *lin
 
           if (prev->value->finished && prev->value->type == VariableDeclaration::Int ||
               prev->value->finished && prev->value->type == VariableDeclaration::Length) {
-            if (post->value->finished && post->value->type == VariableDeclaration::Int) {
+            // Calls have the type Length until the compiler resolves the function
+            if (post->value->finished && post->value->type == VariableDeclaration::Int ||
+                post->value->finished && post->value->type == VariableDeclaration::Length) {
               itMax->value->finished = true;
               itMax->value->type = VariableDeclaration::Int;
               itMax->arguments.push_back(*prev);
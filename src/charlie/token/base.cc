@@ -239,6 +239,10 @@ int Operator::ByteCode() const {
     if (type == VariableDeclaration::Int)
       return vm::IntDivide;
     return -1;
+  case Operator::KindEnum::Modulo:
+    if (type == VariableDeclaration::Int)
+      return vm::IntModulo;
+    return -1;
   case Operator::KindEnum::Copy:
     if (type == VariableDeclaration::Int)
       return vm::IntCopy;
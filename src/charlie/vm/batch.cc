@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <utility>
+
+namespace charlie::vm {
+
+BatchRunner::BatchRunner(std::shared_ptr<const Program> program, int threads)
+    : program_(std::move(program)), threads_(threads) {
+  if (threads_ < 1) threads_ = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+}
+
+std::vector<int> BatchRunner::Run(int instances, Runtime::Engine engine) const {
+  std::vector<int> results(static_cast<size_t>(std::max(instances, 0)), 0);
+  // The workers take the next instance until all are done, which balances instances of different length
+  std::atomic<int> next(0);
+  auto work = [&]() {
+    // Each worker reuses the memory of its states
+    StatePool pool(program_);
+    for (int i = next++; i < instances; i = next++) {
+      Runtime runtime(pool.Acquire());
+      results[i] = runtime.Run(engine);
+      pool.Release(runtime.ReleaseState());
+    }
+  };
+  // The calling thread is one of the workers
+  const int workers = std::min(threads_, instances);
+  std::vector<std::thread> threads;
+  for (int i = 1; i < workers; ++i) threads.emplace_back(work);
+  work();
+  for (auto &thread : threads) thread.join();
+  return results;
+}
+
+}  // namespace charlie::vm
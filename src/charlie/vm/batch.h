@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef CHARLIE_VM_BATCH_H
+#define CHARLIE_VM_BATCH_H
+
+#include <memory>
+#include <vector>
+
+#include "program.h"
+#include "runtime.h"
+#include "state_pool.h"
+
+namespace charlie::vm {
+
+// Runs independent instances of one program in parallel. Each instance gets its own state while all of them share the
+// immutable program image, so starting an instance does not copy the bytecode. Each thread recycles its states through
+// a StatePool.
+class BatchRunner {
+ public:
+  // "threads": Number of worker threads. Uses one per hardware thread if less than one.
+  explicit BatchRunner(std::shared_ptr<const Program> program, int threads = 0);
+  // Runs "instances" instances from the beginning and returns the result of each in order.
+  std::vector<int> Run(int instances, Runtime::Engine engine = Runtime::Engine::Switch) const;
+  inline int GetThreadCount() const { return threads_; }
+
+ private:
+  std::shared_ptr<const Program> program_;
+  int threads_;
+};
+
+}  // namespace charlie::vm
+
+#endif  // !CHARLIE_VM_BATCH_H
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "decoded_program.h"
+
+#include <set>
+
+#include "instruction.h"
+
+namespace charlie::vm {
+
+namespace {
+// Returns true if the engines may continue somewhere else than at the next record
+bool ends_run(int code) {
+  return InstructionManager::GetTargetOperand(code) > -1 || code == InstructionEnums::JumpIf ||
+         code == InstructionEnums::Return || code == InstructionEnums::Exit;
+}
+}  // namespace
+
+DecodedProgram::DecodedProgram() : instructions(), run_lengths(), indices_(), addresses_() {}
+
+bool DecodedProgram::Decode(std::vector<int> const& bytecode) {
+  const int size = static_cast<int>(bytecode.size());
+  instructions.clear();
+  run_lengths.clear();
+  addresses_.clear();
+  indices_.assign(size + 1, -1);
+
+  // Find all instruction beginnings and jump targets
+  std::set<int> targets;
+  int last_const = -1;
+  for (int pos = 0; pos < size;) {
+    int count = InstructionManager::GetOperandCount(bytecode[pos]);
+    if (count < 0 || pos + count >= size) return false;
+    indices_[pos] = 0;
+    int target = InstructionManager::GetTargetOperand(bytecode[pos]);
+    if (target > -1) targets.insert(bytecode[pos + 1 + target]);
+    if (bytecode[pos] == InstructionEnums::JumpIf && last_const > -1) targets.insert(bytecode[last_const + 1]);
+    last_const = bytecode[pos] == InstructionEnums::PushConst ? pos : -1;
+    pos += count + 1;
+  }
+  // Running over the end of the bytecode stops the program
+  indices_[size] = 0;
+
+  for (int target : targets) {
+    if (IndexOf(target) < 0) return false;
+  }
+
+  // Create the records. An else address pushed right before JumpIf becomes its operand.
+  for (int pos = 0; pos < size;) {
+    int code = bytecode[pos];
+    int count = InstructionManager::GetOperandCount(code);
+    int next = pos + count + 1;
+    indices_[pos] = static_cast<int>(instructions.size());
+    addresses_.push_back(pos);
+    if (code == InstructionEnums::PushConst && next < size && bytecode[next] == InstructionEnums::JumpIf &&
+        targets.count(next) == 0 && IndexOf(bytecode[pos + 1]) > -1) {
+      instructions.push_back({InstructionEnums::JumpIf, bytecode[pos + 1], 0, 0, nullptr});
+      indices_[next] = -1;
+      next += 1;
+    } else {
+      int operand = count > 0 ? bytecode[pos + 1] : code == InstructionEnums::JumpIf ? -1 : 0;
+      int operand2 = count > 1 ? bytecode[pos + 2] : 0;
+      int operand3 = count > 2 ? bytecode[pos + 3] : 0;
+      instructions.push_back({code, operand, operand2, operand3, nullptr});
+    }
+    pos = next;
+  }
+  indices_[size] = static_cast<int>(instructions.size());
+  addresses_.push_back(size);
+  instructions.push_back({InstructionEnums::Exit, 0, 0, 0, nullptr});
+
+  // Resolve the targets to record indices
+  for (auto& instruction : instructions) {
+    switch (InstructionManager::GetTargetOperand(instruction.code)) {
+      case 0:
+        instruction.operand = IndexOf(instruction.operand);
+        break;
+      case 1:
+        instruction.operand2 = IndexOf(instruction.operand2);
+        break;
+      case 2:
+        instruction.operand3 = IndexOf(instruction.operand3);
+        break;
+      default:
+        if (instruction.code == InstructionEnums::JumpIf && instruction.operand > -1)
+          instruction.operand = IndexOf(instruction.operand);
+        break;
+    }
+  }
+
+  const int records = static_cast<int>(instructions.size());
+  run_lengths.assign(records, 1);
+  for (int i = records - 2; i > -1; --i) {
+    if (!ends_run(instructions[i].code)) run_lengths[i] = run_lengths[i + 1] + 1;
+  }
+  return true;
+}
+
+}  // namespace charlie::vm
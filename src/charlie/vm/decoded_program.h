@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef CHARLIE_VM_DECODED_PROGRAM_H
+#define CHARLIE_VM_DECODED_PROGRAM_H
+
+#include <vector>
+
+namespace charlie::vm {
+
+// One instruction of the bytecode with its operand already read.
+// Jump and call targets are resolved to indices of the instruction records.
+struct DecodedInstruction {
+  // InstructionEnums of the instruction
+  int code;
+  // Register address, constant value, id of the external function or index of the target record.
+  // JumpIf carries the index of its else record here, or -1 if the address gets popped from the ALU stack.
+  int operand;
+  // Second and third operand of the register instructions.
+  int operand2;
+  int operand3;
+  // Address of the label which executes the instruction. Set in the copies made by Program::GetThreaded.
+  const void* handler;
+};
+
+// The bytecode translated into an array of instruction records at load time.
+// Keeps the mapping between bytecode addresses and record indices, so that the
+// state of the VM can still be expressed in bytecode addresses.
+class DecodedProgram {
+ public:
+  DecodedProgram();
+  // Translates the bytecode into records.
+  // Returns false if the bytecode contains unknown instructions or jumps in between instructions.
+  bool Decode(std::vector<int> const& bytecode);
+  // Returns the index of the record at the bytecode address or -1 if there is no instruction beginning.
+  inline int IndexOf(int address) const {
+    if (address < 0 || address >= static_cast<int>(indices_.size())) return -1;
+    return indices_[address];
+  }
+  // Returns the bytecode address of the record at the specified index.
+  inline int AddressOf(int index) const { return addresses_[index]; }
+  // The records in the order of the bytecode. The last record is an additional Exit.
+  std::vector<DecodedInstruction> instructions;
+  // Number of records from each record up to and including the next one which branches or stops the program.
+  // Engines running with an instruction budget charge it per run of records instead of per instruction.
+  std::vector<int> run_lengths;
+
+ private:
+  // Record index of each bytecode address. -1 inside of an instruction.
+  std::vector<int> indices_;
+  // Bytecode address of each record.
+  std::vector<int> addresses_;
+};
+
+}  // namespace charlie::vm
+
+#endif  // !CHARLIE_VM_DECODED_PROGRAM_H
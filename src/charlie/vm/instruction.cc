@@ -36,7 +36,7 @@ using std::queue;
 array<functionType, InstructionEnums::Length> InstructionManager::Create() {
   auto types = array<functionType, InstructionEnums::Length>();
   types[InstructionEnums::IncreaseRegister] = [](State& state) {
-    int addition = state.program[++state.pos];
+    int addition = state.program->bytecode[++state.pos];
     state.reg.Increase(addition);
     ++state.pos;
     return 0;
@@ -49,7 +49,7 @@ array<functionType, InstructionEnums::Length> InstructionManager::Create() {
   };
 
   types[InstructionEnums::Push] = [](State& state) {
-    int address = state.program[++state.pos];
+    int address = state.program->bytecode[++state.pos];
     int value;
     if (!state.reg.GetValue(address, &value)) return -1;
     state.alu_stack.push(value);
@@ -58,33 +58,28 @@ array<functionType, InstructionEnums::Length> InstructionManager::Create() {
   };
 
   types[InstructionEnums::PushConst] = [](State& state) {
-    int i = state.program[++state.pos];
+    int i = state.program->bytecode[++state.pos];
     state.alu_stack.push(i);
     ++state.pos;
     return 0;
   };
 
-  types[InstructionEnums::IntPop] = [](State& state) {
-    int address = state.program[++state.pos];
-    if (state.alu_stack.empty()) return -1;
-    int value = state.alu_stack.top();
-    state.alu_stack.pop();
-
-    if (!state.reg.SetValue(address, value)) return -1;
-    ++state.pos;
-    return 0;
-  };
-
   types[InstructionEnums::Call] = [](State& state) {
     state.call_stack.push(state.pos + 2);
-    int address = state.program[++state.pos];
+    int address = state.program->bytecode[++state.pos];
     state.pos = address;
     state.reg.StoreFunctionScopes();
     return 0;
   };
 
+  types[InstructionEnums::TailCall] = [](State& state) {
+    state.pos = state.program->bytecode[state.pos + 1];
+    state.reg.ReuseFunctionScopes();
+    return 0;
+  };
+
   types[InstructionEnums::Jump] = [](State& state) {
-    int address = state.program[++state.pos];
+    int address = state.program->bytecode[++state.pos];
 
     state.pos = address;
     return 0;
@@ -117,8 +112,9 @@ array<functionType, InstructionEnums::Length> InstructionManager::Create() {
   };
 
   types[InstructionEnums::CallEx] = [](State& state) {
-    int id = state.program[++state.pos];
-    if (state.external_function_manager != nullptr) state.external_function_manager->Invoke(id, &state.alu_stack);
+    int id = state.program->bytecode[++state.pos];
+    // Parks the program if the result is not available yet
+    state.pending = state.program->external_functions.Invoke(id, &state.alu_stack);
     ++state.pos;
     return 0;
   };
@@ -131,7 +127,7 @@ array<functionType, InstructionEnums::Length> InstructionManager::Create() {
   types[InstructionEnums::IntCopy] = [](State& state) {
     int value = state.alu_stack.top();
     state.alu_stack.pop();
-    int address = state.program[++state.pos];
+    int address = state.program->bytecode[++state.pos];
 
     if (!state.reg.SetValue(address, value)) return -1;
 
@@ -142,7 +138,7 @@ array<functionType, InstructionEnums::Length> InstructionManager::Create() {
   types[InstructionEnums::IntPop] = [](State& state) {
     int value = state.alu_stack.top();
     state.alu_stack.pop();
-    int address = state.program[++state.pos];
+    int address = state.program->bytecode[++state.pos];
 
     if (!state.reg.SetValue(address, value)) return -1;
 
@@ -185,6 +181,7 @@ array<functionType, InstructionEnums::Length> InstructionManager::Create() {
     state.alu_stack.pop();
     int a = state.alu_stack.top();
     state.alu_stack.pop();
+    if (!InstructionManager::CanDivide(a, b)) return -1;
     state.alu_stack.push(a / b);
     ++state.pos;
     return 0;
@@ -195,13 +192,14 @@ array<functionType, InstructionEnums::Length> InstructionManager::Create() {
     state.alu_stack.pop();
     int a = state.alu_stack.top();
     state.alu_stack.pop();
+    if (!InstructionManager::CanDivide(a, b)) return -1;
     state.alu_stack.push(a % b);
     ++state.pos;
     return 0;
   };
 
   types[InstructionEnums::IntIncrease] = [](State& state) {
-    int address = state.program[++state.pos];
+    int address = state.program->bytecode[++state.pos];
 
     int value;
     if (!state.reg.GetValue(address, &value)) return -1;
@@ -213,7 +211,7 @@ array<functionType, InstructionEnums::Length> InstructionManager::Create() {
   };
 
   types[InstructionEnums::IntDecrease] = [](State& state) {
-    int address = state.program[++state.pos];
+    int address = state.program->bytecode[++state.pos];
 
     int value;
     if (!state.reg.GetValue(address, &value)) return -1;
@@ -284,6 +282,119 @@ array<functionType, InstructionEnums::Length> InstructionManager::Create() {
     return 0;
   };
 
+  types[InstructionEnums::MoveRR] = [](State& state) {
+    int destination = state.program->bytecode[++state.pos];
+    int source = state.program->bytecode[++state.pos];
+    int value;
+    if (!state.reg.GetValue(source, &value)) return -1;
+    if (!state.reg.SetValue(destination, value)) return -1;
+    ++state.pos;
+    return 0;
+  };
+
+  types[InstructionEnums::MoveRI] = [](State& state) {
+    int destination = state.program->bytecode[++state.pos];
+    int value = state.program->bytecode[++state.pos];
+    if (!state.reg.SetValue(destination, value)) return -1;
+    ++state.pos;
+    return 0;
+  };
+
+  // Creates the register instruction with the specified operation. The last operand is an immediate if "immediate".
+  // "division": The instruction fails instead of trapping if InstructionManager::CanDivide does not hold.
+  auto createRegisterInstruction = [](auto operation, bool immediate, bool division = false) -> functionType {
+    return [=](State& state) {
+      int destination = state.program->bytecode[++state.pos];
+      int a, b;
+      if (!state.reg.GetValue(state.program->bytecode[++state.pos], &a)) return -1;
+      if (immediate) {
+        b = state.program->bytecode[++state.pos];
+      } else if (!state.reg.GetValue(state.program->bytecode[++state.pos], &b)) {
+        return -1;
+      }
+      if (division && !InstructionManager::CanDivide(a, b)) return -1;
+      if (!state.reg.SetValue(destination, operation(a, b))) return -1;
+      ++state.pos;
+      return 0;
+    };
+  };
+
+  // Creates the instruction which pushes the result of the specified operation.
+  auto createPushInstruction = [](auto operation, bool immediate, bool division = false) -> functionType {
+    return [=](State& state) {
+      int a, b;
+      if (!state.reg.GetValue(state.program->bytecode[++state.pos], &a)) return -1;
+      if (immediate) {
+        b = state.program->bytecode[++state.pos];
+      } else if (!state.reg.GetValue(state.program->bytecode[++state.pos], &b)) {
+        return -1;
+      }
+      if (division && !InstructionManager::CanDivide(a, b)) return -1;
+      state.alu_stack.push(operation(a, b));
+      ++state.pos;
+      return 0;
+    };
+  };
+
+  // Creates the instruction which jumps if the specified comparison holds.
+  auto createBranchInstruction = [](auto comparison, bool immediate) -> functionType {
+    return [=](State& state) {
+      int a, b;
+      if (!state.reg.GetValue(state.program->bytecode[++state.pos], &a)) return -1;
+      if (immediate) {
+        b = state.program->bytecode[++state.pos];
+      } else if (!state.reg.GetValue(state.program->bytecode[++state.pos], &b)) {
+        return -1;
+      }
+      int address = state.program->bytecode[++state.pos];
+      if (comparison(a, b))
+        state.pos = address;
+      else
+        ++state.pos;
+      return 0;
+    };
+  };
+
+  for (bool immediate : {false, true}) {
+    const int offset = immediate ? InstructionEnums::IntAddRRI : InstructionEnums::IntAddRRR;
+    types[offset + 0] = createRegisterInstruction([](int a, int b) { return a + b; }, immediate);
+    types[offset + 1] = createRegisterInstruction([](int a, int b) { return a - b; }, immediate);
+    types[offset + 2] = createRegisterInstruction([](int a, int b) { return a * b; }, immediate);
+    types[offset + 3] = createRegisterInstruction([](int a, int b) { return a / b; }, immediate, true);
+    types[offset + 4] = createRegisterInstruction([](int a, int b) { return a % b; }, immediate, true);
+  }
+
+  for (bool immediate : {false, true}) {
+    const int offset = immediate ? InstructionEnums::PushIntAddRI : InstructionEnums::PushIntAddRR;
+    types[offset + 0] = createPushInstruction([](int a, int b) { return a + b; }, immediate);
+    types[offset + 1] = createPushInstruction([](int a, int b) { return a - b; }, immediate);
+    types[offset + 2] = createPushInstruction([](int a, int b) { return a * b; }, immediate);
+    types[offset + 3] = createPushInstruction([](int a, int b) { return a / b; }, immediate, true);
+    types[offset + 4] = createPushInstruction([](int a, int b) { return a % b; }, immediate, true);
+  }
+
+  for (bool immediate : {false, true}) {
+    const int offset = immediate ? InstructionEnums::JumpIfIntEqualRI : InstructionEnums::JumpIfIntEqualRR;
+    types[offset + 0] = createBranchInstruction([](int a, int b) { return a == b; }, immediate);
+    types[offset + 1] = createBranchInstruction([](int a, int b) { return a != b; }, immediate);
+    types[offset + 2] = createBranchInstruction([](int a, int b) { return a > b; }, immediate);
+    types[offset + 3] = createBranchInstruction([](int a, int b) { return a >= b; }, immediate);
+    types[offset + 4] = createBranchInstruction([](int a, int b) { return a < b; }, immediate);
+    types[offset + 5] = createBranchInstruction([](int a, int b) { return a <= b; }, immediate);
+  }
+
+  types[InstructionEnums::JumpIfZero] = [](State& state) {
+    int address = state.program->bytecode[++state.pos];
+    int condition = state.alu_stack.top();
+    state.alu_stack.pop();
+
+    if (condition != 0)
+      ++state.pos;
+    else
+      state.pos = address;
+    return 0;
+  };
+
   return types;
 }
 
@@ -314,6 +425,10 @@ void InstructionManager::GetLegend(int instruction, queue<const char*>* comments
       comments->push("Calls function ...");
       comments->push("... address of function");
       break;
+    case InstructionEnums::TailCall:
+      comments->push("Calls function in place of the current one ...");
+      comments->push("... address of function");
+      break;
     case InstructionEnums::CallEx:
       comments->push("Calls external function ...");
       comments->push("... Id of function");
@@ -376,10 +491,279 @@ void InstructionManager::GetLegend(int instruction, queue<const char*>* comments
     case InstructionEnums::Exit:
       comments->push("Exit program");
       break;
+    case InstructionEnums::MoveRR:
+      comments->push("Copies a register ...");
+      comments->push("... to address");
+      comments->push("... from address");
+      break;
+    case InstructionEnums::MoveRI:
+      comments->push("Sets a register ...");
+      comments->push("... at address");
+      comments->push("... to constant");
+      break;
+    case InstructionEnums::IntAddRRR:
+    case InstructionEnums::IntSubstractRRR:
+    case InstructionEnums::IntMultiplyRRR:
+    case InstructionEnums::IntDivideRRR:
+    case InstructionEnums::IntModuloRRR:
+      comments->push("Calculates two registers ...");
+      comments->push("... to address");
+      comments->push("... first operand address");
+      comments->push("... second operand address");
+      break;
+    case InstructionEnums::IntAddRRI:
+    case InstructionEnums::IntSubstractRRI:
+    case InstructionEnums::IntMultiplyRRI:
+    case InstructionEnums::IntDivideRRI:
+    case InstructionEnums::IntModuloRRI:
+      comments->push("Calculates a register and a constant ...");
+      comments->push("... to address");
+      comments->push("... first operand address");
+      comments->push("... second operand constant");
+      break;
+    case InstructionEnums::PushIntAddRR:
+    case InstructionEnums::PushIntSubstractRR:
+    case InstructionEnums::PushIntMultiplyRR:
+    case InstructionEnums::PushIntDivideRR:
+    case InstructionEnums::PushIntModuloRR:
+      comments->push("Pushs the result of two registers ...");
+      comments->push("... first operand address");
+      comments->push("... second operand address");
+      break;
+    case InstructionEnums::PushIntAddRI:
+    case InstructionEnums::PushIntSubstractRI:
+    case InstructionEnums::PushIntMultiplyRI:
+    case InstructionEnums::PushIntDivideRI:
+    case InstructionEnums::PushIntModuloRI:
+      comments->push("Pushs the result of a register and a constant ...");
+      comments->push("... first operand address");
+      comments->push("... second operand constant");
+      break;
+    case InstructionEnums::JumpIfIntEqualRR:
+    case InstructionEnums::JumpIfIntNotEqualRR:
+    case InstructionEnums::JumpIfIntGreaterRR:
+    case InstructionEnums::JumpIfIntGreaterEqualRR:
+    case InstructionEnums::JumpIfIntLessRR:
+    case InstructionEnums::JumpIfIntLessEqualRR:
+      comments->push("Jumps if the comparison of two registers holds ...");
+      comments->push("... first operand address");
+      comments->push("... second operand address");
+      comments->push("... address to jump");
+      break;
+    case InstructionEnums::JumpIfIntEqualRI:
+    case InstructionEnums::JumpIfIntNotEqualRI:
+    case InstructionEnums::JumpIfIntGreaterRI:
+    case InstructionEnums::JumpIfIntGreaterEqualRI:
+    case InstructionEnums::JumpIfIntLessRI:
+    case InstructionEnums::JumpIfIntLessEqualRI:
+      comments->push("Jumps if the comparison of a register and a constant holds ...");
+      comments->push("... first operand address");
+      comments->push("... second operand constant");
+      comments->push("... address to jump");
+      break;
+    case InstructionEnums::JumpIfZero:
+      comments->push("Jumps if the condition is zero ...");
+      comments->push("... address to jump");
+      break;
+    default:
+      break;
+  }
+}
+const char* InstructionManager::GetName(int instruction) {
+  // Same order as InstructionEnums
+  static const char* const names[] = {"IncreaseRegister", "DecreaseRegister", "Push", "PushConst", "IntPop", "Call",
+                                      "CallEx", "Jump", "JumpIf", "Return", "IntCopy", "IntAdd", "IntSubstract",
+                                      "IntMultiply", "IntDivide", "IntModulo", "IntIncrease", "IntDecrease", "IntEqual",
+                                      "IntNotEqual", "IntGreater", "IntGreaterEqual", "IntLess", "IntLessEqual", "Exit",
+                                      "MoveRR", "MoveRI", "IntAddRRR", "IntSubstractRRR", "IntMultiplyRRR",
+                                      "IntDivideRRR", "IntModuloRRR", "IntAddRRI", "IntSubstractRRI", "IntMultiplyRRI",
+                                      "IntDivideRRI", "IntModuloRRI", "PushIntAddRR", "PushIntSubstractRR",
+                                      "PushIntMultiplyRR", "PushIntDivideRR", "PushIntModuloRR", "PushIntAddRI",
+                                      "PushIntSubstractRI", "PushIntMultiplyRI", "PushIntDivideRI", "PushIntModuloRI",
+                                      "JumpIfIntEqualRR", "JumpIfIntNotEqualRR", "JumpIfIntGreaterRR",
+                                      "JumpIfIntGreaterEqualRR", "JumpIfIntLessRR", "JumpIfIntLessEqualRR",
+                                      "JumpIfIntEqualRI", "JumpIfIntNotEqualRI", "JumpIfIntGreaterRI",
+                                      "JumpIfIntGreaterEqualRI", "JumpIfIntLessRI", "JumpIfIntLessEqualRI",
+                                      "JumpIfZero", "TailCall"};
+  static_assert(sizeof(names) / sizeof(names[0]) == InstructionEnums::Length, "Missing name of an instruction");
+  if (instruction < 0 || instruction >= InstructionEnums::Length) return "Unknown";
+  return names[instruction];
+}
+int InstructionManager::GetOperandCount(int instruction) {
+  switch (instruction) {
+    case InstructionEnums::IncreaseRegister:
+    case InstructionEnums::Push:
+    case InstructionEnums::PushConst:
+    case InstructionEnums::IntPop:
+    case InstructionEnums::Call:
+    case InstructionEnums::CallEx:
+    case InstructionEnums::Jump:
+    case InstructionEnums::IntCopy:
+    case InstructionEnums::IntIncrease:
+    case InstructionEnums::IntDecrease:
+    case InstructionEnums::JumpIfZero:
+    case InstructionEnums::TailCall:
+      return 1;
+    case InstructionEnums::DecreaseRegister:
+    case InstructionEnums::JumpIf:
+    case InstructionEnums::Return:
+    case InstructionEnums::IntAdd:
+    case InstructionEnums::IntSubstract:
+    case InstructionEnums::IntMultiply:
+    case InstructionEnums::IntDivide:
+    case InstructionEnums::IntModulo:
+    case InstructionEnums::IntEqual:
+    case InstructionEnums::IntNotEqual:
+    case InstructionEnums::IntGreater:
+    case InstructionEnums::IntGreaterEqual:
+    case InstructionEnums::IntLess:
+    case InstructionEnums::IntLessEqual:
+    case InstructionEnums::Exit:
+      return 0;
+    case InstructionEnums::MoveRR:
+    case InstructionEnums::MoveRI:
+    case InstructionEnums::PushIntAddRR:
+    case InstructionEnums::PushIntSubstractRR:
+    case InstructionEnums::PushIntMultiplyRR:
+    case InstructionEnums::PushIntDivideRR:
+    case InstructionEnums::PushIntModuloRR:
+    case InstructionEnums::PushIntAddRI:
+    case InstructionEnums::PushIntSubstractRI:
+    case InstructionEnums::PushIntMultiplyRI:
+    case InstructionEnums::PushIntDivideRI:
+    case InstructionEnums::PushIntModuloRI:
+      return 2;
+    case InstructionEnums::IntAddRRR:
+    case InstructionEnums::IntSubstractRRR:
+    case InstructionEnums::IntMultiplyRRR:
+    case InstructionEnums::IntDivideRRR:
+    case InstructionEnums::IntModuloRRR:
+    case InstructionEnums::IntAddRRI:
+    case InstructionEnums::IntSubstractRRI:
+    case InstructionEnums::IntMultiplyRRI:
+    case InstructionEnums::IntDivideRRI:
+    case InstructionEnums::IntModuloRRI:
+    case InstructionEnums::JumpIfIntEqualRR:
+    case InstructionEnums::JumpIfIntNotEqualRR:
+    case InstructionEnums::JumpIfIntGreaterRR:
+    case InstructionEnums::JumpIfIntGreaterEqualRR:
+    case InstructionEnums::JumpIfIntLessRR:
+    case InstructionEnums::JumpIfIntLessEqualRR:
+    case InstructionEnums::JumpIfIntEqualRI:
+    case InstructionEnums::JumpIfIntNotEqualRI:
+    case InstructionEnums::JumpIfIntGreaterRI:
+    case InstructionEnums::JumpIfIntGreaterEqualRI:
+    case InstructionEnums::JumpIfIntLessRI:
+    case InstructionEnums::JumpIfIntLessEqualRI:
+      return 3;
+    default:
+      return -1;
+  }
+}
+
+int InstructionManager::GetStackEffect(int instruction) {
+  switch (instruction) {
+    case InstructionEnums::Push:
+    case InstructionEnums::PushConst:
+    case InstructionEnums::PushIntAddRR:
+    case InstructionEnums::PushIntSubstractRR:
+    case InstructionEnums::PushIntMultiplyRR:
+    case InstructionEnums::PushIntDivideRR:
+    case InstructionEnums::PushIntModuloRR:
+    case InstructionEnums::PushIntAddRI:
+    case InstructionEnums::PushIntSubstractRI:
+    case InstructionEnums::PushIntMultiplyRI:
+    case InstructionEnums::PushIntDivideRI:
+    case InstructionEnums::PushIntModuloRI:
+      return 1;
+    case InstructionEnums::IntPop:
+    case InstructionEnums::IntCopy:
+    case InstructionEnums::IntAdd:
+    case InstructionEnums::IntSubstract:
+    case InstructionEnums::IntMultiply:
+    case InstructionEnums::IntDivide:
+    case InstructionEnums::IntModulo:
+    case InstructionEnums::IntEqual:
+    case InstructionEnums::IntNotEqual:
+    case InstructionEnums::IntGreater:
+    case InstructionEnums::IntGreaterEqual:
+    case InstructionEnums::IntLess:
+    case InstructionEnums::IntLessEqual:
+    case InstructionEnums::JumpIfZero:
+      return -1;
+    case InstructionEnums::JumpIf:
+      return -2;
+    default:
+      return 0;
+  }
+}
+
+int InstructionManager::GetTargetOperand(int instruction) {
+  switch (instruction) {
+    case InstructionEnums::Call:
+    case InstructionEnums::Jump:
+    case InstructionEnums::JumpIfZero:
+    case InstructionEnums::TailCall:
+      return 0;
+    case InstructionEnums::JumpIfIntEqualRR:
+    case InstructionEnums::JumpIfIntNotEqualRR:
+    case InstructionEnums::JumpIfIntGreaterRR:
+    case InstructionEnums::JumpIfIntGreaterEqualRR:
+    case InstructionEnums::JumpIfIntLessRR:
+    case InstructionEnums::JumpIfIntLessEqualRR:
+    case InstructionEnums::JumpIfIntEqualRI:
+    case InstructionEnums::JumpIfIntNotEqualRI:
+    case InstructionEnums::JumpIfIntGreaterRI:
+    case InstructionEnums::JumpIfIntGreaterEqualRI:
+    case InstructionEnums::JumpIfIntLessRI:
+    case InstructionEnums::JumpIfIntLessEqualRI:
+      return 2;
+    default:
+      return -1;
+  }
+}
+
+int InstructionManager::GetRegisterOperands(int instruction) {
+  switch (instruction) {
+    case InstructionEnums::Push:
+    case InstructionEnums::IntPop:
+    case InstructionEnums::IntCopy:
+    case InstructionEnums::IntIncrease:
+    case InstructionEnums::IntDecrease:
+    case InstructionEnums::MoveRI:
+      return 0b1;
+    case InstructionEnums::MoveRR:
+      return 0b11;
     default:
       break;
   }
+  if (instruction >= InstructionEnums::IntAddRRR && instruction <= InstructionEnums::IntModuloRRR) return 0b111;
+  if (instruction >= InstructionEnums::IntAddRRI && instruction <= InstructionEnums::IntModuloRRI) return 0b11;
+  if (instruction >= InstructionEnums::PushIntAddRR && instruction <= InstructionEnums::PushIntModuloRR) return 0b11;
+  if (instruction >= InstructionEnums::PushIntAddRI && instruction <= InstructionEnums::PushIntModuloRI) return 0b1;
+  if (instruction >= InstructionEnums::JumpIfIntEqualRR && instruction <= InstructionEnums::JumpIfIntLessEqualRR)
+    return 0b11;
+  if (instruction >= InstructionEnums::JumpIfIntEqualRI && instruction <= InstructionEnums::JumpIfIntLessEqualRI)
+    return 0b1;
+  return 0;
+}
+
+int InstructionManager::NegateComparison(int comparison) {
+  // Same order as IntEqual ... IntLessEqual
+  static const int negated[] = {InstructionEnums::IntNotEqual,     InstructionEnums::IntEqual,
+                                InstructionEnums::IntLessEqual,    InstructionEnums::IntLess,
+                                InstructionEnums::IntGreaterEqual, InstructionEnums::IntGreater};
+  return negated[comparison - InstructionEnums::IntEqual];
+}
+
+int InstructionManager::MirrorComparison(int comparison) {
+  // Same order as IntEqual ... IntLessEqual
+  static const int mirrored[] = {InstructionEnums::IntEqual,   InstructionEnums::IntNotEqual,
+                                 InstructionEnums::IntLess,    InstructionEnums::IntLessEqual,
+                                 InstructionEnums::IntGreater, InstructionEnums::IntGreaterEqual};
+  return mirrored[comparison - InstructionEnums::IntEqual];
 }
+
 const array<functionType, InstructionEnums::Length> InstructionManager::Instructions = InstructionManager::Create();
 
 }  // namespace vm
@@ -28,6 +28,7 @@
 #ifndef CHARLIE_VM_INSTRUCTION_H
 #define CHARLIE_VM_INSTRUCTION_H
 
+#include <climits>
 #include <functional>
 
 #include <array>
@@ -67,6 +68,53 @@ enum InstructionEnums {
   IntLess,
   IntLessEqual,
   Exit,
+  // Register instructions: Work directly on the register without the ALU stack.
+  // "R" stands for a register address and "I" for an immediate constant. The first operand is the destination.
+  MoveRR,
+  MoveRI,
+  // Same order as IntAdd ... IntModulo
+  IntAddRRR,
+  IntSubstractRRR,
+  IntMultiplyRRR,
+  IntDivideRRR,
+  IntModuloRRR,
+  // Same order as IntAdd ... IntModulo
+  IntAddRRI,
+  IntSubstractRRI,
+  IntMultiplyRRI,
+  IntDivideRRI,
+  IntModuloRRI,
+  // Push the result of an operation on registers onto the ALU stack. Same order as IntAdd ... IntModulo
+  PushIntAddRR,
+  PushIntSubstractRR,
+  PushIntMultiplyRR,
+  PushIntDivideRR,
+  PushIntModuloRR,
+  // Same order as IntAdd ... IntModulo
+  PushIntAddRI,
+  PushIntSubstractRI,
+  PushIntMultiplyRI,
+  PushIntDivideRI,
+  PushIntModuloRI,
+  // Jump to the address of the last operand if the comparison holds. Same order as IntEqual ... IntLessEqual
+  JumpIfIntEqualRR,
+  JumpIfIntNotEqualRR,
+  JumpIfIntGreaterRR,
+  JumpIfIntGreaterEqualRR,
+  JumpIfIntLessRR,
+  JumpIfIntLessEqualRR,
+  // Same order as IntEqual ... IntLessEqual
+  JumpIfIntEqualRI,
+  JumpIfIntNotEqualRI,
+  JumpIfIntGreaterRI,
+  JumpIfIntGreaterEqualRI,
+  JumpIfIntLessRI,
+  JumpIfIntLessEqualRI,
+  // Pops the condition and jumps to the address of the operand if it is zero
+  JumpIfZero,
+  // Calls the function at the address of the operand in place of the current one. The callee returns to the caller of
+  // the current function.
+  TailCall,
   Length
 };
 // Type of callback function of each instruction
@@ -83,6 +131,28 @@ class InstructionManager {
   // Returns the legend to the specified bytecode.
   // Used when saving the program as a textfile.
   static void GetLegend(int instruction, std::queue<const char*> *comments);
+  // Returns the name of the specified bytecode or "Unknown".
+  static const char *GetName(int instruction);
+  // Returns the number of operands following the specified bytecode.
+  // Returns -1 if it is not a valid bytecode.
+  static int GetOperandCount(int instruction);
+  // Returns the number of values the specified bytecode pushes onto the ALU stack minus the number it pops.
+  // The effect of Call and CallEx depends on the called function and is not included.
+  static int GetStackEffect(int instruction);
+  // Returns the index of the operand which holds a bytecode address (e.g. of Jump or Call).
+  // Returns -1 if the specified bytecode has no such operand.
+  static int GetTargetOperand(int instruction);
+  // Returns a bit mask of the operands which hold register addresses. Bit 0 stands for the first operand.
+  static int GetRegisterOperands(int instruction);
+  // Returns the comparison (IntEqual ... IntLessEqual) which holds if the specified one does not.
+  static int NegateComparison(int comparison);
+  // Returns the comparison (IntEqual ... IntLessEqual) which holds for swapped operands.
+  static int MirrorComparison(int comparison);
+  // Returns false if dividing "dividend" by "divisor" traps, i.e. for division by zero and of INT_MIN by -1.
+  // The engines halt the program instead of raising the signal.
+  static inline bool CanDivide(int dividend, int divisor) {
+    return divisor != 0 && (divisor != -1 || dividend != INT_MIN);
+  }
   // Stores all the instructions.
   static const std::array<functionType, InstructionEnums::Length> Instructions;
 };
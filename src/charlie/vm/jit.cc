@@ -0,0 +1,580 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "jit.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__unix__)
+#define CHARLIE_JIT_X86_64
+#include <sys/mman.h>
+#endif
+
+#include "instruction.h"
+
+namespace charlie::vm {
+
+namespace {
+
+// Data shared between the native code and the runtime. The native code addresses the members relative to r15.
+struct Context {
+  // Pointer behind the top value of the ALU stack
+  int *sp;
+  // The ALU stack has to be reserved again when a jump, call or return finds sp above this
+  int *sp_limit;
+  // Register::GlobalBase() and Register::FrameBase()
+  int *globals;
+  int *frame;
+  // Native address of each record
+  const void *const *entries;
+  // Index of the record at which the native code stopped
+  int index;
+  State *state;
+  const DecodedProgram *program;
+};
+
+// Why the native code returned to the runtime
+enum ExitReason { Fallback, Reserve, Finished, Returned, Halt };
+
+// Updates the register bases after the register changed
+inline void load_bases(Context *context) {
+  context->globals = context->state->reg.GlobalBase();
+  context->frame = context->state->reg.FrameBase();
+}
+
+#ifdef CHARLIE_JIT_X86_64
+
+// Helpers called by the native code. Registers (and thus the bases) can change in all of them.
+int increase_register(Context *context, int size) {
+  bool succeeded = context->state->reg.Increase(size);
+  load_bases(context);
+  return succeeded ? 1 : 0;
+}
+
+int decrease_register(Context *context) {
+  bool succeeded = context->state->reg.Decrease();
+  load_bases(context);
+  return succeeded ? 1 : 0;
+}
+
+void call_function(Context *context, int return_index) {
+  context->state->call_stack.push(context->program->AddressOf(return_index));
+  context->state->reg.StoreFunctionScopes();
+  load_bases(context);
+}
+
+void tail_call_function(Context *context) {
+  context->state->reg.ReuseFunctionScopes();
+  load_bases(context);
+}
+
+// Returns the index of the record to continue with, -1 if the call stack is empty or -2 on an invalid address
+int return_function(Context *context) {
+  auto &call_stack = context->state->call_stack;
+  if (call_stack.empty()) return -1;
+  const int index = context->program->IndexOf(call_stack.top());
+  if (index < 0) return -2;
+  call_stack.pop();
+  context->state->reg.RestoreFunctionScopes();
+  load_bases(context);
+  return index;
+}
+
+// Machine registers. The native code keeps the ALU stack pointer in rbx, the register bases in r12 (globals) and
+// r13 (frame), the entry table in r14 and the context in r15. rax, rcx and rdx are scratch registers.
+enum Reg { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7, R12 = 12, R13 = 13, R14 = 14, R15 = 15 };
+
+// Condition codes of jcc and setcc. Same order as IntEqual ... IntLessEqual
+const uint8_t kConditions[] = {0x4 /* e */, 0x5 /* ne */, 0xF /* g */, 0xD /* ge */, 0xC /* l */, 0xE /* le */};
+
+class Assembler {
+ public:
+  std::vector<uint8_t> buffer;
+
+  size_t Size() const { return buffer.size(); }
+  void Byte(uint8_t value) { buffer.push_back(value); }
+  void Bytes(std::initializer_list<uint8_t> values) { buffer.insert(buffer.end(), values); }
+  void Dword(int32_t value) {
+    uint8_t bytes[4];
+    memcpy(bytes, &value, 4);
+    buffer.insert(buffer.end(), bytes, bytes + 4);
+  }
+  void Qword(uint64_t value) {
+    uint8_t bytes[8];
+    memcpy(bytes, &value, 8);
+    buffer.insert(buffer.end(), bytes, bytes + 8);
+  }
+  void PatchDword(size_t position, int32_t value) { memcpy(&buffer[position], &value, 4); }
+
+  // Emits "opcode reg, [base + disp32]". "wide" selects 64 bit operands.
+  void Memory(std::initializer_list<uint8_t> opcode, int reg, int base, int32_t disp, bool wide = false) {
+    uint8_t rex = 0x40 | (wide ? 0x08 : 0) | (reg >= 8 ? 0x04 : 0) | (base >= 8 ? 0x01 : 0);
+    if (rex != 0x40) Byte(rex);
+    Bytes(opcode);
+    Byte(0x80 | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == RSP) Byte(0x24);
+    Dword(disp);
+  }
+
+  // Loads a 64 bit member of the context into the register
+  void LoadContext(int reg, size_t offset) { Memory({0x8B}, reg, R15, static_cast<int32_t>(offset), true); }
+  // Stores a 64 bit register into a member of the context
+  void StoreContext(size_t offset, int reg) { Memory({0x89}, reg, R15, static_cast<int32_t>(offset), true); }
+
+  // Operand of a register address: Globals are addressed relative to r12, all others relative to r13
+  int Base(int address) const { return address < globals ? R12 : R13; }
+  // mov reg32, [register address]
+  void Load(int reg, int address) { Memory({0x8B}, reg, Base(address), address * 4); }
+  // mov [register address], reg32
+  void Store(int address, int reg) { Memory({0x89}, reg, Base(address), address * 4); }
+  // mov dword [register address], imm32
+  void StoreImmediate(int address, int32_t value) {
+    Memory({0xC7}, 0, Base(address), address * 4);
+    Dword(value);
+  }
+  // add dword [register address], imm32
+  void AddImmediate(int address, int32_t value) {
+    Memory({0x81}, 0, Base(address), address * 4);
+    Dword(value);
+  }
+
+  // mov [rbx], reg32; add rbx, 4
+  void Push(int reg) {
+    Memory({0x89}, reg, RBX, 0);
+    Bytes({0x48, 0x83, 0xC3, 0x04});
+  }
+  // sub rbx, 4; mov reg32, [rbx]
+  void Pop(int reg) {
+    Bytes({0x48, 0x83, 0xEB, 0x04});
+    Memory({0x8B}, reg, RBX, 0);
+  }
+  // mov reg32, imm32 (reg < 8)
+  void MoveImmediate(int reg, int32_t value) {
+    Byte(0xB8 + reg);
+    Dword(value);
+  }
+
+  // eax = eax <op> ecx. "operation" is the offset from IntAdd. Divisions which would trap (see
+  // InstructionManager::CanDivide) leave the native code at the record "index" with Halt.
+  void Arithmetic(int operation, int index) {
+    if (operation >= 3) {
+      Bytes({0x85, 0xC9, 0x74});  // test ecx, ecx; jz to the halt
+      size_t zero = Size();
+      Byte(0);
+      Bytes({0x83, 0xF9, 0xFF, 0x75});  // cmp ecx, -1; jne over the halt
+      size_t divisor = Size();
+      Byte(0);
+      Byte(0x3D);  // cmp eax, INT_MIN
+      Dword(INT32_MIN);
+      Byte(0x75);  // jne over the halt
+      size_t dividend = Size();
+      Byte(0);
+      buffer[zero] = static_cast<uint8_t>(Size() - (zero + 1));
+      Exit(Halt, index);
+      buffer[divisor] = static_cast<uint8_t>(Size() - (divisor + 1));
+      buffer[dividend] = static_cast<uint8_t>(Size() - (dividend + 1));
+    }
+    switch (operation) {
+      case 0:
+        Bytes({0x01, 0xC8});  // add eax, ecx
+        break;
+      case 1:
+        Bytes({0x29, 0xC8});  // sub eax, ecx
+        break;
+      case 2:
+        Bytes({0x0F, 0xAF, 0xC1});  // imul eax, ecx
+        break;
+      case 3:
+        Bytes({0x99, 0xF7, 0xF9});  // cdq; idiv ecx
+        break;
+      default:
+        Bytes({0x99, 0xF7, 0xF9, 0x89, 0xD0});  // cdq; idiv ecx; mov eax, edx
+        break;
+    }
+  }
+
+  // Jumps to the entry of a record. The displacement gets patched when all records are emitted.
+  void JumpTo(int index, uint8_t condition = 0xFF) {
+    if (condition == 0xFF) {
+      Byte(0xE9);
+    } else {
+      Bytes({0x0F, static_cast<uint8_t>(0x80 | condition)});
+    }
+    fixups.push_back({Size(), index});
+    Dword(0);
+  }
+
+  // Calls the helper with the context as first and "argument" as optional second argument
+  void CallHelper(const void *helper, bool has_argument = false, int32_t argument = 0) {
+    Bytes({0x4C, 0x89, 0xFF});  // mov rdi, r15
+    if (has_argument) MoveImmediate(RSI, argument);
+    Bytes({0x48, 0xB8});  // mov rax, imm64
+    Qword(reinterpret_cast<uint64_t>(helper));
+    Bytes({0xFF, 0xD0});  // call rax
+  }
+
+  // Reloads r12 and r13 after the register changed
+  void LoadBases() {
+    LoadContext(R12, offsetof(Context, globals));
+    LoadContext(R13, offsetof(Context, frame));
+  }
+
+  // Leaves the native code at the record "index"
+  void Exit(ExitReason reason, int index) {
+    Memory({0xC7}, 0, R15, offsetof(Context, index));  // mov dword [r15 + index], imm32
+    Dword(index);
+    MoveImmediate(RAX, reason);
+    Byte(0xE9);
+    Dword(static_cast<int32_t>(exit_position - (Size() + 4)));
+  }
+
+  // Leaves the native code to reserve the ALU stack if rbx exceeds the limit. "index" is the record to continue at.
+  void CheckStack(int index) {
+    Memory({0x3B}, RBX, R15, offsetof(Context, sp_limit), true);  // cmp rbx, [r15 + sp_limit]
+    Bytes({0x0F, 0x86});                                         // jbe over the exit
+    size_t skip = Size();
+    Dword(0);
+    Exit(Reserve, index);
+    PatchDword(skip, static_cast<int32_t>(Size() - (skip + 4)));
+  }
+
+  struct Fixup {
+    size_t position;
+    int index;
+  };
+  std::vector<Fixup> fixups;
+  // Position of the common exit code
+  size_t exit_position = 0;
+  // Number of global variables
+  int globals = 0;
+};
+
+// Emits the entry trampoline: int enter(Context *context, const void *entry)
+void emit_trampoline(Assembler *a) {
+  // Save the callee saved registers and align the stack to 16 bytes
+  a->Bytes({0x55, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57});
+  a->Bytes({0x48, 0x83, 0xEC, 0x08});  // sub rsp, 8
+  a->Bytes({0x49, 0x89, 0xFF});        // mov r15, rdi
+  a->LoadContext(RBX, offsetof(Context, sp));
+  a->LoadBases();
+  a->LoadContext(R14, offsetof(Context, entries));
+  a->Bytes({0xFF, 0xE6});  // jmp rsi
+
+  // Common exit: eax holds the reason
+  a->exit_position = a->Size();
+  a->StoreContext(offsetof(Context, sp), RBX);
+  a->Bytes({0x48, 0x83, 0xC4, 0x08});  // add rsp, 8
+  a->Bytes({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0x5D, 0xC3});
+}
+
+// Emits the template of the record at "index"
+void emit_record(Assembler *a, DecodedInstruction const &record, int index) {
+  const int code = record.code;
+  switch (code) {
+    case InstructionEnums::IncreaseRegister:
+    case InstructionEnums::DecreaseRegister: {
+      if (code == InstructionEnums::IncreaseRegister)
+        a->CallHelper(reinterpret_cast<const void *>(&increase_register), true, record.operand);
+      else
+        a->CallHelper(reinterpret_cast<const void *>(&decrease_register));
+      a->LoadBases();
+      a->Bytes({0x85, 0xC0, 0x75});  // test eax, eax; jnz over the exit
+      size_t skip = a->Size();
+      a->Byte(0);
+      a->Exit(Halt, index);
+      a->buffer[skip] = static_cast<uint8_t>(a->Size() - (skip + 1));
+      break;
+    }
+    case InstructionEnums::Push:
+      a->Load(RAX, record.operand);
+      a->Push(RAX);
+      break;
+    case InstructionEnums::PushConst:
+      a->Memory({0xC7}, 0, RBX, 0);  // mov dword [rbx], imm32
+      a->Dword(record.operand);
+      a->Bytes({0x48, 0x83, 0xC3, 0x04});  // add rbx, 4
+      break;
+    case InstructionEnums::IntPop:
+    case InstructionEnums::IntCopy:
+      a->Pop(RAX);
+      a->Store(record.operand, RAX);
+      break;
+    case InstructionEnums::Call:
+      a->CallHelper(reinterpret_cast<const void *>(&call_function), true, index + 1);
+      a->LoadBases();
+      a->CheckStack(record.operand);
+      a->JumpTo(record.operand);
+      break;
+    case InstructionEnums::TailCall:
+      a->CallHelper(reinterpret_cast<const void *>(&tail_call_function));
+      a->LoadBases();
+      a->CheckStack(record.operand);
+      a->JumpTo(record.operand);
+      break;
+    case InstructionEnums::Jump:
+      a->CheckStack(record.operand);
+      a->JumpTo(record.operand);
+      break;
+    case InstructionEnums::JumpIf:
+      if (record.operand < 0) {
+        a->Exit(Fallback, index);
+        break;
+      }
+      a->Pop(RAX);
+      a->Bytes({0x85, 0xC0});  // test eax, eax
+      a->JumpTo(record.operand, 0x4);
+      break;
+    case InstructionEnums::JumpIfZero:
+      a->Pop(RAX);
+      a->Bytes({0x85, 0xC0});  // test eax, eax
+      a->JumpTo(record.operand, 0x4);
+      break;
+    case InstructionEnums::Return: {
+      a->CallHelper(reinterpret_cast<const void *>(&return_function));
+      a->Bytes({0x89, 0xC0});        // mov eax, eax (zero extends rax)
+      a->Bytes({0x85, 0xC0, 0x79});  // test eax, eax; jns to the continuation
+      size_t skip = a->Size();
+      a->Byte(0);
+      a->Bytes({0x83, 0xF8, 0xFF, 0x75});  // cmp eax, -1; jne to the halt
+      size_t halt = a->Size();
+      a->Byte(0);
+      a->Exit(Returned, index);
+      a->buffer[halt] = static_cast<uint8_t>(a->Size() - (halt + 1));
+      a->Exit(Halt, index);
+      a->buffer[skip] = static_cast<uint8_t>(a->Size() - (skip + 1));
+      a->LoadBases();
+      // Reserve the ALU stack: The runtime continues at the record stored in the context
+      a->Memory({0x3B}, RBX, R15, offsetof(Context, sp_limit), true);  // cmp rbx, [r15 + sp_limit]
+      a->Bytes({0x76});                                               // jbe over the exit
+      size_t fits = a->Size();
+      a->Byte(0);
+      a->Memory({0x89}, RAX, R15, offsetof(Context, index));  // mov [r15 + index], eax
+      a->MoveImmediate(RAX, Reserve);
+      a->Byte(0xE9);
+      a->Dword(static_cast<int32_t>(a->exit_position - (a->Size() + 4)));
+      a->buffer[fits] = static_cast<uint8_t>(a->Size() - (fits + 1));
+      a->Bytes({0x41, 0xFF, 0x24, 0xC6});  // jmp [r14 + rax * 8]
+      break;
+    }
+    case InstructionEnums::IntAdd:
+    case InstructionEnums::IntSubstract:
+    case InstructionEnums::IntMultiply:
+    case InstructionEnums::IntDivide:
+    case InstructionEnums::IntModulo:
+      a->Pop(RCX);
+      a->Memory({0x8B}, RAX, RBX, -4);  // mov eax, [rbx - 4]
+      a->Arithmetic(code - InstructionEnums::IntAdd, index);
+      a->Memory({0x89}, RAX, RBX, -4);  // mov [rbx - 4], eax
+      break;
+    case InstructionEnums::IntIncrease:
+      a->AddImmediate(record.operand, 1);
+      break;
+    case InstructionEnums::IntDecrease:
+      a->AddImmediate(record.operand, -1);
+      break;
+    case InstructionEnums::IntEqual:
+    case InstructionEnums::IntNotEqual:
+    case InstructionEnums::IntGreater:
+    case InstructionEnums::IntGreaterEqual:
+    case InstructionEnums::IntLess:
+    case InstructionEnums::IntLessEqual:
+      a->Pop(RCX);
+      a->Memory({0x8B}, RAX, RBX, -4);  // mov eax, [rbx - 4]
+      a->Bytes({0x39, 0xC8});           // cmp eax, ecx
+      a->Bytes({0x0F, static_cast<uint8_t>(0x90 | kConditions[code - InstructionEnums::IntEqual]), 0xC0});
+      a->Bytes({0x0F, 0xB6, 0xC0});     // movzx eax, al
+      a->Memory({0x89}, RAX, RBX, -4);  // mov [rbx - 4], eax
+      break;
+    case InstructionEnums::Exit:
+      a->Exit(Finished, index);
+      break;
+    case InstructionEnums::MoveRR:
+      a->Load(RAX, record.operand2);
+      a->Store(record.operand, RAX);
+      break;
+    case InstructionEnums::MoveRI:
+      a->StoreImmediate(record.operand, record.operand2);
+      break;
+    default:
+      if (code >= InstructionEnums::IntAddRRR && code <= InstructionEnums::IntModuloRRI) {
+        const bool immediate = code >= InstructionEnums::IntAddRRI;
+        a->Load(RAX, record.operand2);
+        if (immediate)
+          a->MoveImmediate(RCX, record.operand3);
+        else
+          a->Load(RCX, record.operand3);
+        a->Arithmetic(code - (immediate ? InstructionEnums::IntAddRRI : InstructionEnums::IntAddRRR), index);
+        a->Store(record.operand, RAX);
+      } else if (code >= InstructionEnums::PushIntAddRR && code <= InstructionEnums::PushIntModuloRI) {
+        const bool immediate = code >= InstructionEnums::PushIntAddRI;
+        a->Load(RAX, record.operand);
+        if (immediate)
+          a->MoveImmediate(RCX, record.operand2);
+        else
+          a->Load(RCX, record.operand2);
+        a->Arithmetic(code - (immediate ? InstructionEnums::PushIntAddRI : InstructionEnums::PushIntAddRR), index);
+        a->Push(RAX);
+      } else if (code >= InstructionEnums::JumpIfIntEqualRR && code <= InstructionEnums::JumpIfIntLessEqualRI) {
+        const bool immediate = code >= InstructionEnums::JumpIfIntEqualRI;
+        a->Load(RAX, record.operand);
+        if (immediate) {
+          a->Byte(0x3D);  // cmp eax, imm32
+          a->Dword(record.operand2);
+        } else {
+          a->Load(RCX, record.operand2);
+          a->Bytes({0x39, 0xC8});  // cmp eax, ecx
+        }
+        a->JumpTo(record.operand3,
+                  kConditions[code - (immediate ? InstructionEnums::JumpIfIntEqualRI : InstructionEnums::JumpIfIntEqualRR)]);
+      } else {
+        // CallEx and everything without a template
+        a->Exit(Fallback, index);
+      }
+      break;
+  }
+}
+
+#endif  // CHARLIE_JIT_X86_64
+
+}  // namespace
+
+Jit::Jit() : code_(nullptr), code_size_(0), entries_(), program_(nullptr) {}
+
+Jit::~Jit() {
+#ifdef CHARLIE_JIT_X86_64
+  if (code_ != nullptr) munmap(code_, code_size_);
+#endif
+}
+
+bool Jit::IsSupported() {
+#ifdef CHARLIE_JIT_X86_64
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool Jit::Compile(DecodedProgram const &program) {
+#ifdef CHARLIE_JIT_X86_64
+  // The first record enters the global scope, which tells the number of globals
+  if (program.instructions.empty() || program.instructions.front().code != InstructionEnums::IncreaseRegister)
+    return false;
+
+  Assembler a;
+  a.globals = program.instructions.front().operand;
+  emit_trampoline(&a);
+  std::vector<size_t> positions;
+  positions.reserve(program.instructions.size());
+  for (size_t i = 0; i < program.instructions.size(); ++i) {
+    positions.push_back(a.Size());
+    emit_record(&a, program.instructions[i], static_cast<int>(i));
+  }
+  for (auto &fixup : a.fixups) {
+    if (fixup.index < 0 || fixup.index >= static_cast<int>(positions.size())) return false;
+    a.PatchDword(fixup.position, static_cast<int32_t>(positions[fixup.index] - (fixup.position + 4)));
+  }
+
+  void *memory = mmap(nullptr, a.Size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) return false;
+  memcpy(memory, a.buffer.data(), a.Size());
+  if (mprotect(memory, a.Size(), PROT_READ | PROT_EXEC) != 0) {
+    munmap(memory, a.Size());
+    return false;
+  }
+  if (code_ != nullptr) munmap(code_, code_size_);
+  code_ = static_cast<uint8_t *>(memory);
+  code_size_ = a.Size();
+  entries_.clear();
+  for (size_t position : positions) entries_.push_back(code_ + position);
+  program_ = &program;
+  return true;
+#else
+  return false;
+#endif
+}
+
+int Jit::interpret(State *state, int index) const {
+  state->pos = program_->AddressOf(index);
+  do {
+    if (InstructionManager::Instructions[state->program->bytecode[state->pos]](*state) < 0) {
+      // Keep the position of the failed instruction like the other engines
+      return -1;
+    }
+  } while (state->pos > -1 && program_->IndexOf(state->pos) < 0);
+  return state->pos < 0 ? -1 : program_->IndexOf(state->pos);
+}
+
+int Jit::Run(State *state) const {
+  if (code_ != nullptr && state->pos > -1) {
+    auto enter = reinterpret_cast<int (*)(Context *, const void *)>(code_);
+    Context context;
+    context.entries = entries_.data();
+    context.state = state;
+    context.program = program_;
+    const int stack_depth = state->program->GetMaxStackDepth();
+    int index = program_->IndexOf(state->pos);
+    while (index > -1) {
+      Stack &stack = state->alu_stack;
+      stack.Reserve(stack_depth);
+      context.sp = stack.TopPointer();
+      context.sp_limit = stack.EndPointer() - stack_depth;
+      load_bases(&context);
+
+      const int reason = enter(&context, entries_[index]);
+      stack.SetTopPointer(context.sp);
+      index = context.index;
+      switch (reason) {
+        case Fallback:
+          index = interpret(state, index);
+          // Parked by an asynchronous external function. The state points to the next instruction.
+          if (state->pending != nullptr) index = -1;
+          break;
+        case Reserve:
+          break;
+        case Finished:
+          state->pos = -1;
+          index = -1;
+          break;
+        case Returned:
+          state->pos = -2;
+          index = -1;
+          break;
+        case Halt:
+        default:
+          state->pos = program_->AddressOf(index);
+          index = -1;
+          break;
+      }
+    }
+  }
+  if (state->alu_stack.empty()) return 0;
+  return state->alu_stack.top();
+}
+
+}  // namespace charlie::vm
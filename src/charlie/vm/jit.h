@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef CHARLIE_VM_JIT_H
+#define CHARLIE_VM_JIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "decoded_program.h"
+#include "state.h"
+
+namespace charlie::vm {
+
+// Baseline JIT: Translates each record of the decoded program into a fixed template of x86-64 code.
+// The native code keeps the ALU stack pointer and the register bases in machine registers.
+// Records without a template (CallEx and JumpIf with a popped address) leave the native code. They get executed by
+// the handlers of InstructionManager before the native code continues with the following record.
+// Register addresses are not checked: The runtime only compiles programs which passed VerifyProgram.
+class Jit {
+ public:
+  Jit();
+  ~Jit();
+  Jit(const Jit &) = delete;
+  Jit &operator=(const Jit &) = delete;
+  // Returns true if native code can be generated on this platform.
+  static bool IsSupported();
+  // Translates the program. The program must outlive the JIT.
+  // Returns false if the platform is not supported or the program has no global scope to begin with.
+  bool Compile(DecodedProgram const &program);
+  // Runs the compiled program beginning at state->pos and returns the value on top of the ALU stack.
+  // Does not modify the JIT, so any number of threads may run it with their own state.
+  int Run(State *state) const;
+
+ private:
+  // Executes the records at "index" with the handlers of InstructionManager until the next record begins.
+  // Returns the index of that record or -1 if the program stopped.
+  int interpret(State *state, int index) const;
+
+  // Executable memory. Begins with the entry trampoline.
+  uint8_t *code_;
+  size_t code_size_;
+  // Native address of each record
+  std::vector<const void *> entries_;
+  const DecodedProgram *program_;
+};
+
+}  // namespace charlie::vm
+
+#endif  // !CHARLIE_VM_JIT_H
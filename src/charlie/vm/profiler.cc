@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <queue>
+#include <string>
+
+#include "instruction.h"
+
+namespace charlie::vm {
+
+namespace {
+#ifdef CHARLIE_PROFILER_RDTSC
+const char *const kTimeUnit = "cycles/op";
+#else
+const char *const kTimeUnit = "ns/op";
+#endif
+// Width of the histogram bar of an opcode taking all the time
+const int kBarWidth = 40;
+}  // namespace
+
+Profiler::Profiler(int sample_interval)
+    : program_(nullptr),
+      sample_interval_(std::max(sample_interval, 1)),
+      countdown_(1),
+      sampled_(-1),
+      begin_(0),
+      counts_(),
+      cycles_(),
+      samples_() {}
+
+void Profiler::Reset(DecodedProgram const &program) {
+  program_ = &program;
+  countdown_ = sample_interval_;
+  sampled_ = -1;
+  counts_.assign(program.instructions.size(), 0);
+  cycles_.assign(InstructionEnums::Length, 0);
+  samples_.assign(InstructionEnums::Length, 0);
+}
+
+void Profiler::Report(std::ostream *out, int limit) const {
+  if (program_ == nullptr) return;
+  std::ostream &stream = *out;
+
+  std::vector<uint64_t> executions(InstructionEnums::Length, 0);
+  uint64_t total = 0;
+  for (size_t i = 0; i < counts_.size(); ++i) {
+    executions[program_->instructions[i].code] += counts_[i];
+    total += counts_[i];
+  }
+  if (total == 0) return;
+
+  // Estimate the time of each opcode by its executions and the mean of its samples
+  std::vector<double> per_op(InstructionEnums::Length, 0.0);
+  std::vector<double> time(InstructionEnums::Length, 0.0);
+  double total_time = 0.0;
+  std::vector<int> opcodes;
+  for (int code = 0; code < InstructionEnums::Length; ++code) {
+    if (executions[code] == 0) continue;
+    opcodes.push_back(code);
+    if (samples_[code] > 0) per_op[code] = static_cast<double>(cycles_[code]) / samples_[code];
+    time[code] = per_op[code] * executions[code];
+    total_time += time[code];
+  }
+  std::sort(opcodes.begin(), opcodes.end(), [&](int a, int b) {
+    return time[a] != time[b] ? time[a] > time[b] : executions[a] > executions[b];
+  });
+
+  const auto flags = stream.flags();
+  const auto precision = stream.precision();
+  stream << std::fixed << std::setprecision(1);
+  stream << "Executed records: " << total << "\n\n";
+  stream << std::left << std::setw(24) << "Opcode" << std::right << std::setw(14) << "Executions" << std::setw(8)
+         << "%" << std::setw(12) << kTimeUnit << std::setw(8) << "Time %"
+         << "\n";
+  for (int code : opcodes) {
+    const double share = total_time > 0 ? 100.0 * time[code] / total_time : 0.0;
+    const std::string bar(static_cast<size_t>(share * kBarWidth / 100.0 + 0.5), '#');
+    stream << std::left << std::setw(24) << InstructionManager::GetName(code) << std::right << std::setw(14)
+           << executions[code] << std::setw(8) << 100.0 * executions[code] / total << std::setw(12) << per_op[code]
+           << std::setw(8) << share << (bar.empty() ? "" : "  ") << bar << "\n";
+  }
+
+  std::vector<int> records;
+  for (size_t i = 0; i < counts_.size(); ++i) {
+    if (counts_[i] > 0) records.push_back(static_cast<int>(i));
+  }
+  std::sort(records.begin(), records.end(), [&](int a, int b) { return counts_[a] > counts_[b]; });
+  if (static_cast<int>(records.size()) > limit) records.resize(std::max(limit, 0));
+
+  stream << "\n"
+         << std::setw(8) << "Address"
+         << "  " << std::left << std::setw(24) << "Opcode" << std::right << std::setw(14) << "Executions"
+         << std::setw(8) << "%"
+         << "  Legend\n";
+  for (int index : records) {
+    const int code = program_->instructions[index].code;
+    std::queue<const char *> legend;
+    InstructionManager::GetLegend(code, &legend);
+    stream << std::setw(8) << program_->AddressOf(index) << "  " << std::left << std::setw(24)
+           << InstructionManager::GetName(code) << std::right << std::setw(14) << counts_[index] << std::setw(8)
+           << 100.0 * counts_[index] / total << "  " << (legend.empty() ? "" : legend.front()) << "\n";
+  }
+  stream.flags(flags);
+  stream.precision(precision);
+}
+
+}  // namespace charlie::vm
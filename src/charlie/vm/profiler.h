@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef CHARLIE_VM_PROFILER_H
+#define CHARLIE_VM_PROFILER_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CHARLIE_PROFILER_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CHARLIE_PROFILER_RDTSC
+#else
+#include <chrono>
+#endif
+
+#include "decoded_program.h"
+
+namespace charlie::vm {
+
+// Counts how often each record of the decoded program gets executed and samples the time spent in each opcode.
+// Only the switch engine reports to the profiler. It does so in its own instantiation, so the engine does not pay
+// for the profiler when running without one.
+class Profiler {
+ public:
+  // "sample_interval": Measures the time of every n-th executed record
+  explicit Profiler(int sample_interval = 64);
+  // Clears the counters and prepares them for the records of the program. The program must outlive the profiler.
+  void Reset(DecodedProgram const &program);
+  // Gets called by the engine before the record at "index" gets executed.
+  inline void Enter(int index) {
+    ++counts_[index];
+    if (sampled_ > -1) {
+      cycles_[sampled_] += now() - begin_;
+      ++samples_[sampled_];
+      sampled_ = -1;
+    }
+    if (--countdown_ == 0) {
+      countdown_ = sample_interval_;
+      sampled_ = program_->instructions[index].code;
+      begin_ = now();
+    }
+  }
+  // Gets called by the engine when it stops. Drops the sample of the last record.
+  inline void Leave() { sampled_ = -1; }
+  // Prints the opcodes and bytecode addresses with the most executions.
+  // "limit": Maximal number of addresses to print
+  void Report(std::ostream *out, int limit = 20) const;
+
+ private:
+#ifdef CHARLIE_PROFILER_RDTSC
+  static inline uint64_t now() { return __rdtsc(); }
+#else
+  static inline uint64_t now() {
+    return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+  }
+#endif
+
+  const DecodedProgram *program_;
+  int sample_interval_;
+  int countdown_;
+  // Opcode of the record being measured or -1
+  int sampled_;
+  uint64_t begin_;
+  // Executions of each record
+  std::vector<uint64_t> counts_;
+  // Measured time and number of samples of each opcode
+  std::vector<uint64_t> cycles_;
+  std::vector<uint64_t> samples_;
+};
+
+}  // namespace charlie::vm
+
+#endif  // !CHARLIE_VM_PROFILER_H
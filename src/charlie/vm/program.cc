@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "program.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "jit.h"
+#include "verifier.h"
+
+namespace charlie::vm {
+
+Program::Program(std::vector<int> bytecode, int max_stack_depth,
+                 api::ExternalFunctionManager const &external_functions,
+                 std::shared_ptr<const program::Mapping> mapping)
+    : bytecode(std::move(bytecode)),
+      external_functions(external_functions),
+      mapping(std::move(mapping)),
+      decoded_(),
+      verified_(false),
+      max_stack_depth_(max_stack_depth),
+      mutex_(),
+      threaded_(),
+      threaded_overflow_(),
+      jit_(),
+      jit_compiled_(false) {
+  // The engines fall back to the table engine, if the program can not be decoded
+  int stack_depth = 0;
+  verified_ = decoded_.Decode(this->bytecode) && VerifyProgram(decoded_, &this->external_functions, &stack_depth);
+  // Do not rely on the depth stored with the program
+  if (verified_) max_stack_depth_ = std::max(max_stack_depth_, stack_depth);
+}
+
+Program::~Program() {}
+
+const DecodedInstruction *Program::GetThreaded(const void *const *labels) const {
+  // The engines enter their loop once per time slice, so the tables seen before must not lock
+  for (auto const &slot : threaded_) {
+    auto const published = slot.labels.load(std::memory_order_acquire);
+    if (published == labels) return slot.records.data();
+    if (published == nullptr) break;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &slot : threaded_) {
+    auto const published = slot.labels.load(std::memory_order_relaxed);
+    if (published == labels) return slot.records.data();
+    if (published != nullptr) continue;
+    slot.records = decoded_.instructions;
+    for (auto &instruction : slot.records) instruction.handler = labels[instruction.code];
+    slot.labels.store(labels, std::memory_order_release);
+    return slot.records.data();
+  }
+  auto it = threaded_overflow_.find(labels);
+  if (it == threaded_overflow_.end()) {
+    it = threaded_overflow_.insert({labels, decoded_.instructions}).first;
+    for (auto &instruction : it->second) instruction.handler = labels[instruction.code];
+  }
+  return it->second.data();
+}
+
+const Jit *Program::GetJit() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!jit_compiled_) {
+    jit_compiled_ = true;
+    // The native code does not check register addresses
+    if (verified_ && Jit::IsSupported()) {
+      jit_ = std::make_unique<Jit>();
+      if (!jit_->Compile(decoded_)) jit_.reset();
+    }
+  }
+  return jit_.get();
+}
+
+}  // namespace charlie::vm
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef CHARLIE_VM_PROGRAM_H
+#define CHARLIE_VM_PROGRAM_H
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "decoded_program.h"
+
+#include "../api/external_function_manager.h"
+#include "../program/mapping.h"
+
+namespace charlie::vm {
+class Jit;
+
+// Immutable image of a compiled program which any number of states share, also across threads.
+// Holds the bytecode, a frozen copy of the external functions and the source mapping. The bytecode gets decoded and
+// verified once when the image is created.
+class Program {
+ public:
+  // "bytecode": The instructions without the version number
+  // "max_stack_depth": Depth of the ALU stack the compiler calculated for one function
+  Program(std::vector<int> bytecode, int max_stack_depth, api::ExternalFunctionManager const &external_functions,
+          std::shared_ptr<const program::Mapping> mapping = nullptr);
+  ~Program();
+  Program(const Program &) = delete;
+  Program &operator=(const Program &) = delete;
+
+  // The instructions without the version number
+  const std::vector<int> bytecode;
+  // The external functions registered when the image got created
+  const api::ExternalFunctionManager external_functions;
+  // Null if the program has been compiled without source mapping
+  const std::shared_ptr<const program::Mapping> mapping;
+
+  // Returns the records decoded at load time. Empty if the bytecode could not be decoded.
+  inline DecodedProgram const &GetDecoded() const { return decoded_; }
+  // Returns true if the records passed VerifyProgram.
+  inline bool IsVerified() const { return verified_; }
+  // Returns the depth the engines reserve on the ALU stack when entering or leaving a function.
+  inline int GetMaxStackDepth() const { return max_stack_depth_; }
+  // Returns the records with the handlers pointing into the label table of an engine.
+  // Each table gets its own copy of the records on first use. Later calls with the same table do not lock.
+  const DecodedInstruction *GetThreaded(const void *const *labels) const;
+  // Returns the native code of the records or null if the program can not be compiled.
+  // Gets compiled on first use.
+  const Jit *GetJit() const;
+
+ private:
+  // Records threaded for one label table. The table gets published after the records have been filled in.
+  struct Threaded {
+    std::atomic<const void *const *> labels{nullptr};
+    std::vector<DecodedInstruction> records;
+  };
+  // Number of label tables which get looked up without locking. One per variant of the switch engine.
+  static constexpr int kThreadedSlots = 16;
+  DecodedProgram decoded_;
+  bool verified_;
+  int max_stack_depth_;
+  // Caches created on first use
+  mutable std::mutex mutex_;
+  // Get filled in order, so the lookup stops at the first empty slot
+  mutable std::array<Threaded, kThreadedSlots> threaded_;
+  // Further label tables. Guarded by mutex_.
+  mutable std::map<const void *const *, std::vector<DecodedInstruction>> threaded_overflow_;
+  mutable std::unique_ptr<Jit> jit_;
+  mutable bool jit_compiled_;
+};
+
+}  // namespace charlie::vm
+
+#endif  // !CHARLIE_VM_PROGRAM_H
@@ -25,142 +25,85 @@
  * SUCH DAMAGE.
  */
 
-#include <memory.h>
 #include <algorithm>
-#include <cassert>
 
 #include "register.h"
 
 namespace charlie::vm {
 
-Register::Register() : data_(nullptr), size_(0), scope_sizes_(), functions_() {}
+namespace {
+// Initial number of slots of the slab
+constexpr size_t kInitialCapacity = 1024;
+}  // namespace
 
-Register::~Register() {
-  if (data_ != nullptr) {
-    delete data_;
-    data_ = nullptr;
-  }
+Register::Register() : data_(), top_(0), high_water_(0), globals_(-1), offset_(0), scope_sizes_(), frames_() {
+  data_.resize(kInitialCapacity);
 }
 
-bool Register::resize(int change, bool updateFunc) {
-  if (change == 0) return true;
-
-  int newSize = size_ + change;
-  int *newData = new int[newSize];
-
-  if (memcpy(newData, data_, sizeof(int) * std::min(size_, newSize)) == nullptr) {
-    delete[] newData;
-    return false;
-  }
-
-  delete[] data_;
-  data_ = newData;
-  size_ = newSize;
-
-  if (updateFunc && !functions_.empty()) {
-    functions_.top().size += change;
-  }
-
-  return true;
-}
+Register::~Register() {}
 
 bool Register::Increase(int size) {
-  if (data_ == nullptr) {
-    size_ = size;
-    data_ = new int[size_];
-    return true;
+  if (size < 0) return false;
+  const size_t newTop = static_cast<size_t>(top_) + size;
+  if (newTop > data_.size()) data_.resize(std::max(newTop, data_.size() * 2));
+
+  if (globals_ < 0) {
+    // The global scope stays for the whole runtime
+    globals_ = size;
+  } else {
+    scope_sizes_.push_back(size);
   }
-
-  if (!resize(size)) return false;
-
-  scope_sizes_.push(size);
+  top_ = static_cast<int>(newTop);
+  high_water_ = std::max(high_water_, top_);
   return true;
 }
 
 bool Register::Decrease() {
   if (scope_sizes_.empty()) return false;
+  if (!frames_.empty() && static_cast<int>(scope_sizes_.size()) <= frames_.back().scope_count) return false;
 
-  int change = -scope_sizes_.top();
-  scope_sizes_.pop();
-
-  if (!resize(change)) return false;
-
+  top_ -= scope_sizes_.back();
+  scope_sizes_.pop_back();
   return true;
 }
 
-void Register::StoreFunctionScopes() {
-  if (!functions_.empty()) {
-    functions_.top().data = new int[functions_.top().size];
-
-    const int size = functions_.top().size;
-
-    if (memcpy(functions_.top().data, &data_[size_ - size], sizeof(int) * size) == nullptr) {
-      functions_.pop();
-    }
-
-    int i = 0;
-    while (i < size) {
-      functions_.top().scope_sizes_.push(scope_sizes_.top());
-      i += scope_sizes_.top();
-      scope_sizes_.pop();
-    }
+void Register::Reset() {
+  // The next run must not see the variables of the previous one
+  std::fill(data_.begin(), data_.begin() + high_water_, 0);
+  high_water_ = 0;
+  top_ = 0;
+  globals_ = -1;
+  offset_ = 0;
+  scope_sizes_.clear();
+  frames_.clear();
+}
 
-    assert(i == size);
-    resize(-size, false);
-  }
-  functions_.push(FunctionScope());
+void Register::StoreFunctionScopes() {
+  frames_.push_back({offset_, static_cast<int>(scope_sizes_.size())});
+  offset_ = top_ - std::max(globals_, 0);
 }
 
 void Register::RestoreFunctionScopes() {
-  if (functions_.empty()) return;
-
-  functions_.pop();
-
-  if (functions_.empty()) return;
-
-  const int size = functions_.top().size;
-
-  resize(size);
-
-  memcpy(&data_[size_ - size], functions_.top().data, sizeof(int) * size);
-
-  while (!functions_.top().scope_sizes_.empty()) {
-    scope_sizes_.push(functions_.top().scope_sizes_.top());
-    functions_.top().scope_sizes_.pop();
+  if (frames_.empty()) return;
+  const Frame &frame = frames_.back();
+  // Drop the scopes the function did not close itself
+  while (static_cast<int>(scope_sizes_.size()) > frame.scope_count) {
+    top_ -= scope_sizes_.back();
+    scope_sizes_.pop_back();
   }
-  functions_.top().clear();
-}
-
-bool Register::GetValue(int index, int *value) const {
-  if (index >= size_) return false;
-  *value = data_[index];
-  return true;
-}
-
-bool Register::SetValue(int index, int value) {
-  if (index >= size_) return false;
-  data_[index] = value;
-  return true;
+  offset_ = frame.offset;
+  frames_.pop_back();
 }
 
-size_t Register::GetSize() const { return static_cast<size_t>(size_); }
-
-Register::FunctionScope::FunctionScope() : scope_sizes_(), size(), data(nullptr) {}
-
-Register::FunctionScope::~FunctionScope() {
-  if (data != nullptr) {
-    delete data;
-    data = nullptr;
+void Register::ReuseFunctionScopes() {
+  if (frames_.empty()) {
+    StoreFunctionScopes();
+    return;
   }
+  while (static_cast<int>(scope_sizes_.size()) > frames_.back().scope_count) scope_sizes_.pop_back();
+  top_ = offset_ + std::max(globals_, 0);
 }
 
-void Register::FunctionScope::clear() {
-  if (data != nullptr) {
-    delete data;
-    data = nullptr;
-  }
-  size = 0;
-  while (!scope_sizes_.empty()) scope_sizes_.pop();
-}
+size_t Register::GetSize() const { return static_cast<size_t>(top_); }
 
-}  // namespace charlie::vm
\ No newline at end of file
+}  // namespace charlie::vm
@@ -25,7 +25,8 @@
  * SUCH DAMAGE.
  */
 
-#include <stack>
+#include <cstddef>
+#include <vector>
 
 #ifndef CHARLIE_VM_REGISTER_H
 #define CHARLIE_VM_REGISTER_H
@@ -34,6 +35,8 @@ namespace charlie::vm {
 
 // Manages the register memory used to store variable values.
 // Note: Each variable has the size of an integer
+// All scopes live in one growable slab. The first scope holds the global variables, all addresses behind them are
+// relative to the frame of the current function. Entering and leaving scopes or functions only moves indices.
 class Register {
  public:
   Register();
@@ -45,43 +48,70 @@ class Register {
   // Decreases the memory space by the size of the last scope
   // Returns false, if an error occured
   bool Decrease();
-  // Removes the scopes from the registry and archives them in a stack
+  // Closes all scopes and functions and clears the values of the previous run. Keeps the memory.
+  void Reset();
+  // Opens the frame of a called function behind the scopes of the caller
   void StoreFunctionScopes();
-  // Loads the last scopes from the stack and append them to the register
+  // Drops the frame of the returning function and continues with the frame of the caller
   void RestoreFunctionScopes();
+  // Drops all scopes of the current function but keeps its frame for the function it calls in tail position
+  void ReuseFunctionScopes();
   // Gets the value at the spefified index
   // "index": Register index (starting with 0)
   // "value": Pointer to the value where the value should copied to
   // Returns false, if the index exceeds.
-  bool GetValue(int index, int *value) const;
+  inline bool GetValue(int index, int *value) const {
+    const int slot = slot_of(index);
+    if (slot >= top_) return false;
+    *value = data_[slot];
+    return true;
+  }
   // Sets the value at the spefified index
   // "index": Register index (starting with 0)
   // "value": The value to which the register should set to
   // Returns false, if the index exceeds.
-  bool SetValue(int index, int value);
+  inline bool SetValue(int index, int value) {
+    const int slot = slot_of(index);
+    if (slot >= top_) return false;
+    data_[slot] = value;
+    return true;
+  }
+  // Same as GetValue and SetValue but without the bounds check. Only for verified programs.
+  inline int GetValueUnchecked(int index) const { return data_[slot_of(index)]; }
+  inline void SetValueUnchecked(int index, int value) { data_[slot_of(index)] = value; }
   // Returns the size
   size_t GetSize() const;
+  // Returns the slot of the global address 0. Gets invalid when the register grows.
+  inline int *GlobalBase() { return data_.data(); }
+  // Returns the slot which the address 0 of the current function maps to. Only valid for addresses behind the
+  // globals. Gets invalid when the register grows or the frame changes.
+  inline int *FrameBase() { return data_.data() + offset_; }
 
  private:
-  struct FunctionScope {
-    FunctionScope();
-    ~FunctionScope();
-    void clear();
-    // Note that they are in reverse order!
-    std::stack<int> scope_sizes_;
-    int size;
-    int *data;
+  struct Frame {
+    // Offset of the caller
+    int offset;
+    // Number of open scopes of the caller
+    int scope_count;
   };
 
-  bool resize(int change, bool updateFunc = true);
+  // Maps an address to the slot in the slab
+  inline int slot_of(int index) const { return index < globals_ ? index : index + offset_; }
 
-  int *data_;
-  int size_;
-
-  std::stack<int> scope_sizes_;
-  std::stack<FunctionScope> functions_;
+  // All scopes of all active functions
+  std::vector<int> data_;
+  // Number of used slots
+  int top_;
+  // Highest number of used slots since the last reset. The slots behind it are still zero.
+  int high_water_;
+  // Number of global variables. -1 before the global scope has been entered.
+  int globals_;
+  // Added to non global addresses: Begin of the current function frame minus the number of globals
+  int offset_;
+  std::vector<int> scope_sizes_;
+  std::vector<Frame> frames_;
 };
 
 }  // namespace charlie::vm
 
-#endif  // !CHARLIE_VM_REGISTER_H
\ No newline at end of file
+#endif  // !CHARLIE_VM_REGISTER_H
@@ -27,6 +27,7 @@
 
 #include "runtime.h"
 
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 #include <iterator>
@@ -105,7 +106,7 @@ class DebugConnection {
     if (status.ok()) {
       return std::move(command);
     }
-    std::cerr << status.error_message();
+    std::cerr << status.message();
     buffer_ << body_vec;
     return nullptr;
   }
@@ -142,17 +143,683 @@ class DebugConnection {
   tcp::acceptor acceptor_;
 };  // namespace charlie::vm
 
-Runtime::Runtime(std::unique_ptr<State> state, std::shared_ptr<program::Mapping> mapping)
-    : state_(std::move(state)), mapping_(mapping) {}
-int Runtime::Run() {
-  while (state_->pos > -1 /* && !state.call_stack.empty()*/) {
-    int r = InstructionManager::Instructions[state_->program[state_->pos]](*state_);
+Runtime::Runtime(std::unique_ptr<State> state) : state_(std::move(state)), budget_(0), suspended_(false) {}
+
+int Runtime::Run(Engine engine, Profiler* profiler, Sampler* sampler) {
+  if (profiler != nullptr) profiler->Reset(state_->program->GetDecoded());
+  int result;
+  do {
+    // Blocks the thread while the program waits for an asynchronous external function
+    if (state_->pending != nullptr) {
+      state_->pending->Wait();
+      resume();
+    }
+    result = run_engine(engine, profiler, sampler);
+  } while (state_->pending != nullptr);
+  return result;
+}
+
+int Runtime::run_engine(Engine engine, Profiler* profiler, Sampler* sampler) {
+  if (profiler != nullptr || sampler != nullptr) return run_switch(profiler, sampler);
+  switch (engine) {
+    case Engine::Table:
+      return run_table();
+    case Engine::Jit:
+      return run_jit();
+    case Engine::Switch:
+    default:
+      return run_switch();
+  }
+}
+
+void Runtime::resume() {
+  state_->alu_stack.push(state_->pending->GetValue());
+  state_->pending.reset();
+}
+
+Runtime::Status Runtime::RunFor(int64_t budget, std::atomic<bool> const* cancel) {
+  // The loop does not poll the cancellation flag. Large budgets get split into chunks of this size instead.
+  const int64_t kCancelInterval = 1 << 16;
+  if (state_->pending != nullptr) {
+    if (!state_->pending->IsResolved()) return Status::Waiting;
+    resume();
+  }
+  if (state_->pos < 0) return Status::Finished;
+  do {
+    if (cancel != nullptr && cancel->load(std::memory_order_relaxed)) return Status::Cancelled;
+    const int64_t chunk = std::min(budget, kCancelInterval);
+    budget_ = chunk;
+    suspended_ = false;
+    if (state_->program->IsVerified()) {
+      switch_loop<false, false, false, true>(nullptr, nullptr);
+    } else {
+      switch_loop<true, false, false, true>(nullptr, nullptr);
+    }
+    if (state_->pending != nullptr) return Status::Waiting;
+    if (!suspended_) return state_->pos < 0 ? Status::Finished : Status::Halted;
+    // The loop leaves the remaining budget, which is negative after the last run of records
+    budget -= chunk - budget_;
+  } while (budget > 0);
+  return Status::Suspended;
+}
+
+int Runtime::GetResult() const {
+  if (state_->alu_stack.empty()) return 0;
+  return state_->alu_stack.top();
+}
+
+int Runtime::run_table() {
+  while (state_->pos > -1 && state_->pending == nullptr) {
+    int r = InstructionManager::Instructions[state_->program->bytecode[state_->pos]](*state_);
     if (r < 0) break;
   }
   if (state_->alu_stack.empty()) return 0;
   return state_->alu_stack.top();
 }
 
+int Runtime::run_jit() {
+  // Null if the program is not verified or native code is not supported
+  const Jit* jit = state_->program->GetJit();
+  if (jit == nullptr) return run_switch();
+  return jit->Run(state_.get());
+}
+
+namespace {
+// Probes of switch_loop. The specialisations for the variants without profiler or sampler do not touch the pointers,
+// which are null there.
+template <bool kProfile>
+inline void profile_enter(Profiler* profiler, int index) {
+  profiler->Enter(index);
+}
+template <>
+inline void profile_enter<false>(Profiler*, int) {}
+
+template <bool kProfile>
+inline void profile_leave(Profiler* profiler) {
+  profiler->Leave();
+}
+template <>
+inline void profile_leave<false>(Profiler*) {}
+
+template <bool kSample>
+inline bool sample_requested(std::atomic<bool> const* pending) {
+  return pending->load(std::memory_order_relaxed);
+}
+template <>
+inline bool sample_requested<false>(std::atomic<bool> const*) {
+  return false;
+}
+}  // namespace
+
+// GCC and clang support labels as values. The records then store the address of their label,
+// which saves the bounds check and the jump table of the switch statement and gives each
+// instruction its own indirect branch.
+#if defined(__GNUC__)
+#define CHARLIE_COMPUTED_GOTO
+#endif
+
+// Reports the next record to the profiler. Compiled out when running without one.
+#define PROFILE() profile_enter<kProfile>(profiler, static_cast<int>(ip - code))
+
+#ifdef CHARLIE_COMPUTED_GOTO
+// Takes the sample in one place outside of the handlers
+#define TAKE_SAMPLE() goto sample
+#define INSTRUCTION(name) L_##name:
+#define DISPATCH()     \
+  do {                 \
+    PROFILE();         \
+    goto* ip->handler; \
+  } while (false)
+#else
+#define TAKE_SAMPLE() sampler->Take(decoded.AddressOf(static_cast<int>(ip - code)), state.call_stack)
+#define INSTRUCTION(name) case InstructionEnums::name:
+#define DISPATCH() continue
+#endif
+
+// Dispatches after a jump, call or return. Only these poll the sampler and charge the budget with the run of records
+// starting at the target, which keeps the straight-line instructions as fast as without them.
+// Compiled out when running without a sampler or budget.
+#define DISPATCH_BRANCH()                                                 \
+  if (sample_requested<kSample>(pending)) TAKE_SAMPLE();                  \
+  if (kBudget && (budget -= run_lengths[ip - code]) < 0) goto suspend;    \
+  DISPATCH()
+
+// Register access of the switch loop. Verified programs address only their frame and skip the bounds check.
+#define GET_REGISTER(index, value) \
+  (kChecked ? reg.GetValue(index, &(value)) : ((value) = reg.GetValueUnchecked(index), true))
+#define SET_REGISTER(index, value) \
+  (kChecked ? reg.SetValue(index, value) : (reg.SetValueUnchecked(index, value), true))
+
+// ALU stack access of the switch loop. Verified programs never pop below the values they pushed and stay within the
+// depth reserved at each branch. Other programs halt when popping below the bottom and grow the stack when needed.
+#define CHECK_POP(count) \
+  if (kChecked && sp - stack.BottomPointer() < (count)) goto halt
+#define CHECK_PUSH()                            \
+  do {                                          \
+    if (kChecked && sp == stack.EndPointer()) { \
+      stack.SetTopPointer(sp);                  \
+      stack.Reserve(1);                         \
+      sp = stack.TopPointer();                  \
+    }                                           \
+  } while (false)
+
+// Writes the local stack pointer back, reserves the depth of a function and reloads the pointer
+#define RESERVE_STACK()         \
+  do {                          \
+    stack.SetTopPointer(sp);    \
+    stack.Reserve(stack_depth); \
+    sp = stack.TopPointer();    \
+  } while (false)
+
+int Runtime::run_switch(Profiler* profiler, Sampler* sampler) {
+  return state_->program->IsVerified() ? select_loop<false>(profiler, sampler) : select_loop<true>(profiler, sampler);
+}
+
+template <bool kChecked>
+int Runtime::select_loop(Profiler* profiler, Sampler* sampler) {
+  if (profiler != nullptr) {
+    return sampler != nullptr ? switch_loop<kChecked, true, true, false>(profiler, sampler)
+                              : switch_loop<kChecked, true, false, false>(profiler, nullptr);
+  }
+  return sampler != nullptr ? switch_loop<kChecked, false, true, false>(nullptr, sampler)
+                            : switch_loop<kChecked, false, false, false>(nullptr, nullptr);
+}
+
+template <bool kChecked, bool kProfile, bool kSample, bool kBudget>
+int Runtime::switch_loop(Profiler* profiler, Sampler* sampler) {
+  State& state = *state_;
+  Program const& program = *state.program;
+  DecodedProgram const& decoded = program.GetDecoded();
+  if (decoded.instructions.empty()) return run_table();
+  if (state.pos < 0) return state.alu_stack.empty() ? 0 : state.alu_stack.top();
+
+#ifdef CHARLIE_COMPUTED_GOTO
+  // Must have the same order as InstructionEnums
+  static void* const labels[] = {&&L_IncreaseRegister,        &&L_DecreaseRegister,        &&L_Push,
+                                 &&L_PushConst,               &&L_IntPop,                  &&L_Call,
+                                 &&L_CallEx,                  &&L_Jump,                    &&L_JumpIf,
+                                 &&L_Return,                  &&L_IntCopy,                 &&L_IntAdd,
+                                 &&L_IntSubstract,            &&L_IntMultiply,             &&L_IntDivide,
+                                 &&L_IntModulo,               &&L_IntIncrease,             &&L_IntDecrease,
+                                 &&L_IntEqual,                &&L_IntNotEqual,             &&L_IntGreater,
+                                 &&L_IntGreaterEqual,         &&L_IntLess,                 &&L_IntLessEqual,
+                                 &&L_Exit,                    &&L_MoveRR,                  &&L_MoveRI,
+                                 &&L_IntAddRRR,               &&L_IntSubstractRRR,         &&L_IntMultiplyRRR,
+                                 &&L_IntDivideRRR,            &&L_IntModuloRRR,            &&L_IntAddRRI,
+                                 &&L_IntSubstractRRI,         &&L_IntMultiplyRRI,          &&L_IntDivideRRI,
+                                 &&L_IntModuloRRI,            &&L_PushIntAddRR,            &&L_PushIntSubstractRR,
+                                 &&L_PushIntMultiplyRR,       &&L_PushIntDivideRR,         &&L_PushIntModuloRR,
+                                 &&L_PushIntAddRI,            &&L_PushIntSubstractRI,      &&L_PushIntMultiplyRI,
+                                 &&L_PushIntDivideRI,         &&L_PushIntModuloRI,         &&L_JumpIfIntEqualRR,
+                                 &&L_JumpIfIntNotEqualRR,     &&L_JumpIfIntGreaterRR,      &&L_JumpIfIntGreaterEqualRR,
+                                 &&L_JumpIfIntLessRR,         &&L_JumpIfIntLessEqualRR,    &&L_JumpIfIntEqualRI,
+                                 &&L_JumpIfIntNotEqualRI,     &&L_JumpIfIntGreaterRI,      &&L_JumpIfIntGreaterEqualRI,
+                                 &&L_JumpIfIntLessRI,         &&L_JumpIfIntLessEqualRI,    &&L_JumpIfZero,
+                                 &&L_TailCall};
+  static_assert(sizeof(labels) / sizeof(labels[0]) == InstructionEnums::Length, "Missing label of an instruction");
+  // Each variant of the loop has its own labels
+  const DecodedInstruction* const code = program.GetThreaded(labels);
+#else
+  const DecodedInstruction* const code = decoded.instructions.data();
+#endif
+  const DecodedInstruction* ip = code + decoded.IndexOf(state.pos);
+  Stack& stack = state.alu_stack;
+  Register& reg = state.reg;
+  int a, b;
+  // Local copy of the stack pointer. The depth the compiler calculated for each function is reserved when entering or
+  // leaving a function and on jumps (loops may leak values of unused expressions), so the operations need no checks.
+  const int stack_depth = program.GetMaxStackDepth();
+  stack.Reserve(stack_depth);
+  int* sp = stack.TopPointer();
+  // Request of the sampler thread
+  std::atomic<bool> const* const pending = kSample ? sampler->PendingFlag() : nullptr;
+  // Instructions left to run
+  int64_t budget = budget_;
+  const int* const run_lengths = decoded.run_lengths.data();
+
+#ifdef CHARLIE_COMPUTED_GOTO
+  DISPATCH();
+#else
+  for (;;) {
+    PROFILE();
+    switch (ip->code) {
+#endif
+
+  INSTRUCTION(IncreaseRegister) {
+    reg.Increase(ip->operand);
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(DecreaseRegister) {
+    if (!reg.Decrease()) goto halt;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(Push) {
+    if (!GET_REGISTER(ip->operand, a)) goto halt;
+    CHECK_PUSH();
+    *sp++ = a;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(PushConst) {
+    CHECK_PUSH();
+    *sp++ = ip->operand;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntPop)
+  INSTRUCTION(IntCopy) {
+    CHECK_POP(1);
+    a = *--sp;
+    if (!SET_REGISTER(ip->operand, a)) goto halt;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(Call) {
+    state.call_stack.push(decoded.AddressOf(static_cast<int>(ip - code) + 1));
+    ip = code + ip->operand;
+    reg.StoreFunctionScopes();
+    RESERVE_STACK();
+    DISPATCH_BRANCH();
+  }
+  INSTRUCTION(TailCall) {
+    ip = code + ip->operand;
+    reg.ReuseFunctionScopes();
+    RESERVE_STACK();
+    DISPATCH_BRANCH();
+  }
+  INSTRUCTION(CallEx) {
+    CHECK_POP(program.external_functions.GetArgumentCount(ip->operand));
+    stack.SetTopPointer(sp);
+    state.pending = program.external_functions.Invoke(ip->operand, &stack);
+    sp = stack.TopPointer();
+    ++ip;
+    if (state.pending != nullptr) goto park;
+    DISPATCH();
+  }
+  INSTRUCTION(Jump) {
+    ip = code + ip->operand;
+    RESERVE_STACK();
+    DISPATCH_BRANCH();
+  }
+  INSTRUCTION(JumpIf) {
+    CHECK_POP(ip->operand > -1 ? 1 : 2);
+    if (ip->operand > -1) {
+      a = ip->operand;
+    } else {
+      a = decoded.IndexOf(*--sp);
+    }
+    b = *--sp;
+    if (b != 0) {
+      ++ip;
+    } else {
+      if (a < 0) goto halt;
+      ip = code + a;
+    }
+    DISPATCH_BRANCH();
+  }
+  INSTRUCTION(Return) {
+    if (state.call_stack.empty()) {
+      state.pos = -2;
+      goto end;
+    }
+    a = decoded.IndexOf(state.call_stack.top());
+    if (a < 0) goto halt;
+    ip = code + a;
+    state.call_stack.pop();
+    reg.RestoreFunctionScopes();
+    RESERVE_STACK();
+    DISPATCH_BRANCH();
+  }
+  INSTRUCTION(IntAdd) {
+    CHECK_POP(2);
+    a = *--sp;
+    sp[-1] += a;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntSubstract) {
+    CHECK_POP(2);
+    a = *--sp;
+    sp[-1] -= a;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntMultiply) {
+    CHECK_POP(2);
+    a = *--sp;
+    sp[-1] *= a;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntDivide) {
+    CHECK_POP(2);
+    a = *--sp;
+    if (!InstructionManager::CanDivide(sp[-1], a)) goto halt;
+    sp[-1] /= a;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntModulo) {
+    CHECK_POP(2);
+    a = *--sp;
+    if (!InstructionManager::CanDivide(sp[-1], a)) goto halt;
+    sp[-1] %= a;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntIncrease) {
+    if (!GET_REGISTER(ip->operand, a)) goto halt;
+    SET_REGISTER(ip->operand, a + 1);
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntDecrease) {
+    if (!GET_REGISTER(ip->operand, a)) goto halt;
+    SET_REGISTER(ip->operand, a - 1);
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntEqual) {
+    CHECK_POP(2);
+    a = *--sp;
+    sp[-1] = sp[-1] == a ? 1 : 0;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntNotEqual) {
+    CHECK_POP(2);
+    a = *--sp;
+    sp[-1] = sp[-1] != a ? 1 : 0;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntGreater) {
+    CHECK_POP(2);
+    a = *--sp;
+    sp[-1] = sp[-1] > a ? 1 : 0;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntGreaterEqual) {
+    CHECK_POP(2);
+    a = *--sp;
+    sp[-1] = sp[-1] >= a ? 1 : 0;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntLess) {
+    CHECK_POP(2);
+    a = *--sp;
+    sp[-1] = sp[-1] < a ? 1 : 0;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntLessEqual) {
+    CHECK_POP(2);
+    a = *--sp;
+    sp[-1] = sp[-1] <= a ? 1 : 0;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(Exit) {
+    state.pos = -1;
+    goto end;
+  }
+  INSTRUCTION(MoveRR) {
+    if (!GET_REGISTER(ip->operand2, a)) goto halt;
+    if (!SET_REGISTER(ip->operand, a)) goto halt;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(MoveRI) {
+    if (!SET_REGISTER(ip->operand, ip->operand2)) goto halt;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntAddRRR) {
+    if (!GET_REGISTER(ip->operand2, a) || !GET_REGISTER(ip->operand3, b)) goto halt;
+    if (!SET_REGISTER(ip->operand, a + b)) goto halt;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntSubstractRRR) {
+    if (!GET_REGISTER(ip->operand2, a) || !GET_REGISTER(ip->operand3, b)) goto halt;
+    if (!SET_REGISTER(ip->operand, a - b)) goto halt;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntMultiplyRRR) {
+    if (!GET_REGISTER(ip->operand2, a) || !GET_REGISTER(ip->operand3, b)) goto halt;
+    if (!SET_REGISTER(ip->operand, a * b)) goto halt;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntDivideRRR) {
+    if (!GET_REGISTER(ip->operand2, a) || !GET_REGISTER(ip->operand3, b)) goto halt;
+    if (!InstructionManager::CanDivide(a, b)) goto halt;
+    if (!SET_REGISTER(ip->operand, a / b)) goto halt;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntModuloRRR) {
+    if (!GET_REGISTER(ip->operand2, a) || !GET_REGISTER(ip->operand3, b)) goto halt;
+    if (!InstructionManager::CanDivide(a, b)) goto halt;
+    if (!SET_REGISTER(ip->operand, a % b)) goto halt;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntAddRRI) {
+    if (!GET_REGISTER(ip->operand2, a)) goto halt;
+    if (!SET_REGISTER(ip->operand, a + ip->operand3)) goto halt;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntSubstractRRI) {
+    if (!GET_REGISTER(ip->operand2, a)) goto halt;
+    if (!SET_REGISTER(ip->operand, a - ip->operand3)) goto halt;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntMultiplyRRI) {
+    if (!GET_REGISTER(ip->operand2, a)) goto halt;
+    if (!SET_REGISTER(ip->operand, a * ip->operand3)) goto halt;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntDivideRRI) {
+    if (!GET_REGISTER(ip->operand2, a)) goto halt;
+    if (!InstructionManager::CanDivide(a, ip->operand3)) goto halt;
+    if (!SET_REGISTER(ip->operand, a / ip->operand3)) goto halt;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(IntModuloRRI) {
+    if (!GET_REGISTER(ip->operand2, a)) goto halt;
+    if (!InstructionManager::CanDivide(a, ip->operand3)) goto halt;
+    if (!SET_REGISTER(ip->operand, a % ip->operand3)) goto halt;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(PushIntAddRR) {
+    if (!GET_REGISTER(ip->operand, a) || !GET_REGISTER(ip->operand2, b)) goto halt;
+    CHECK_PUSH();
+    *sp++ = a + b;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(PushIntSubstractRR) {
+    if (!GET_REGISTER(ip->operand, a) || !GET_REGISTER(ip->operand2, b)) goto halt;
+    CHECK_PUSH();
+    *sp++ = a - b;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(PushIntMultiplyRR) {
+    if (!GET_REGISTER(ip->operand, a) || !GET_REGISTER(ip->operand2, b)) goto halt;
+    CHECK_PUSH();
+    *sp++ = a * b;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(PushIntDivideRR) {
+    if (!GET_REGISTER(ip->operand, a) || !GET_REGISTER(ip->operand2, b)) goto halt;
+    if (!InstructionManager::CanDivide(a, b)) goto halt;
+    CHECK_PUSH();
+    *sp++ = a / b;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(PushIntModuloRR) {
+    if (!GET_REGISTER(ip->operand, a) || !GET_REGISTER(ip->operand2, b)) goto halt;
+    if (!InstructionManager::CanDivide(a, b)) goto halt;
+    CHECK_PUSH();
+    *sp++ = a % b;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(PushIntAddRI) {
+    if (!GET_REGISTER(ip->operand, a)) goto halt;
+    CHECK_PUSH();
+    *sp++ = a + ip->operand2;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(PushIntSubstractRI) {
+    if (!GET_REGISTER(ip->operand, a)) goto halt;
+    CHECK_PUSH();
+    *sp++ = a - ip->operand2;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(PushIntMultiplyRI) {
+    if (!GET_REGISTER(ip->operand, a)) goto halt;
+    CHECK_PUSH();
+    *sp++ = a * ip->operand2;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(PushIntDivideRI) {
+    if (!GET_REGISTER(ip->operand, a)) goto halt;
+    if (!InstructionManager::CanDivide(a, ip->operand2)) goto halt;
+    CHECK_PUSH();
+    *sp++ = a / ip->operand2;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(PushIntModuloRI) {
+    if (!GET_REGISTER(ip->operand, a)) goto halt;
+    if (!InstructionManager::CanDivide(a, ip->operand2)) goto halt;
+    CHECK_PUSH();
+    *sp++ = a % ip->operand2;
+    ++ip;
+    DISPATCH();
+  }
+  INSTRUCTION(JumpIfIntEqualRR) {
+    if (!GET_REGISTER(ip->operand, a) || !GET_REGISTER(ip->operand2, b)) goto halt;
+    ip = a == b ? code + ip->operand3 : ip + 1;
+    DISPATCH_BRANCH();
+  }
+  INSTRUCTION(JumpIfIntNotEqualRR) {
+    if (!GET_REGISTER(ip->operand, a) || !GET_REGISTER(ip->operand2, b)) goto halt;
+    ip = a != b ? code + ip->operand3 : ip + 1;
+    DISPATCH_BRANCH();
+  }
+  INSTRUCTION(JumpIfIntGreaterRR) {
+    if (!GET_REGISTER(ip->operand, a) || !GET_REGISTER(ip->operand2, b)) goto halt;
+    ip = a > b ? code + ip->operand3 : ip + 1;
+    DISPATCH_BRANCH();
+  }
+  INSTRUCTION(JumpIfIntGreaterEqualRR) {
+    if (!GET_REGISTER(ip->operand, a) || !GET_REGISTER(ip->operand2, b)) goto halt;
+    ip = a >= b ? code + ip->operand3 : ip + 1;
+    DISPATCH_BRANCH();
+  }
+  INSTRUCTION(JumpIfIntLessRR) {
+    if (!GET_REGISTER(ip->operand, a) || !GET_REGISTER(ip->operand2, b)) goto halt;
+    ip = a < b ? code + ip->operand3 : ip + 1;
+    DISPATCH_BRANCH();
+  }
+  INSTRUCTION(JumpIfIntLessEqualRR) {
+    if (!GET_REGISTER(ip->operand, a) || !GET_REGISTER(ip->operand2, b)) goto halt;
+    ip = a <= b ? code + ip->operand3 : ip + 1;
+    DISPATCH_BRANCH();
+  }
+  INSTRUCTION(JumpIfIntEqualRI) {
+    if (!GET_REGISTER(ip->operand, a)) goto halt;
+    ip = a == ip->operand2 ? code + ip->operand3 : ip + 1;
+    DISPATCH_BRANCH();
+  }
+  INSTRUCTION(JumpIfIntNotEqualRI) {
+    if (!GET_REGISTER(ip->operand, a)) goto halt;
+    ip = a != ip->operand2 ? code + ip->operand3 : ip + 1;
+    DISPATCH_BRANCH();
+  }
+  INSTRUCTION(JumpIfIntGreaterRI) {
+    if (!GET_REGISTER(ip->operand, a)) goto halt;
+    ip = a > ip->operand2 ? code + ip->operand3 : ip + 1;
+    DISPATCH_BRANCH();
+  }
+  INSTRUCTION(JumpIfIntGreaterEqualRI) {
+    if (!GET_REGISTER(ip->operand, a)) goto halt;
+    ip = a >= ip->operand2 ? code + ip->operand3 : ip + 1;
+    DISPATCH_BRANCH();
+  }
+  INSTRUCTION(JumpIfIntLessRI) {
+    if (!GET_REGISTER(ip->operand, a)) goto halt;
+    ip = a < ip->operand2 ? code + ip->operand3 : ip + 1;
+    DISPATCH_BRANCH();
+  }
+  INSTRUCTION(JumpIfIntLessEqualRI) {
+    if (!GET_REGISTER(ip->operand, a)) goto halt;
+    ip = a <= ip->operand2 ? code + ip->operand3 : ip + 1;
+    DISPATCH_BRANCH();
+  }
+  INSTRUCTION(JumpIfZero) {
+    CHECK_POP(1);
+    ip = *--sp != 0 ? ip + 1 : code + ip->operand;
+    DISPATCH_BRANCH();
+  }
+
+#ifndef CHARLIE_COMPUTED_GOTO
+      default:
+        goto halt;
+    }
+  }
+#else
+sample:
+  sampler->Take(decoded.AddressOf(static_cast<int>(ip - code)), state.call_stack);
+  DISPATCH();
+#endif
+
+suspend:
+  suspended_ = true;
+park:
+  // Out of budget or waiting for an asynchronous external function: Continue at the next record on the next run
+halt:
+  // Stopped by an error: Keep the position of the failed instruction
+  state.pos = decoded.AddressOf(static_cast<int>(ip - code));
+end:
+  if (kBudget) budget_ = budget;
+  profile_leave<kProfile>(profiler);
+  stack.SetTopPointer(sp);
+  if (stack.empty()) return 0;
+  return stack.top();
+}
+
+#undef INSTRUCTION
+#undef DISPATCH
+#undef PROFILE
+#undef DISPATCH_BRANCH
+#undef TAKE_SAMPLE
+#undef RESERVE_STACK
+#undef CHECK_POP
+#undef CHECK_PUSH
+#undef GET_REGISTER
+#undef SET_REGISTER
+#undef CHARLIE_COMPUTED_GOTO
+
 void add_variables(const std::vector<std::unique_ptr<program::Mapping::Scope>>& scopes_map, int pos,
                    const Register& reg, charlie::debug::Event::State* proto_state) {
   // Find scopes
@@ -182,7 +849,7 @@ std::string try_function_name(const std::vector<std::unique_ptr<program::Mapping
   return "__global__";  // For initialisations beside the main() function
 }
 
-void add_callstack(const State& state, std::shared_ptr<program::Mapping> mapping,
+void add_callstack(const State& state, std::shared_ptr<const program::Mapping> mapping,
                    charlie::debug::Event::State* proto_state) {
   auto call_stack = state.call_stack;
   if (mapping == nullptr) {
@@ -199,9 +866,10 @@ void add_callstack(const State& state, std::shared_ptr<program::Mapping> mapping
   }
 }
 
-program::Mapping::Location* Runtime::get_location(int pos) {
-  auto statement_it = mapping_->Instructions.find(pos);
-  if (statement_it != mapping_->Instructions.end()) {
+const program::Mapping::Location* Runtime::get_location(int pos) {
+  auto& mapping = state_->program->mapping;
+  auto statement_it = mapping->Instructions.find(pos);
+  if (statement_it != mapping->Instructions.end()) {
     return &(statement_it->second);
   }
   return nullptr;
@@ -212,8 +880,8 @@ void Runtime::send_event(int code, DebugConnection* connection, int reason) {
   event.set_bytecode(code);
 
   auto state = new charlie::debug::Event::State();
-  add_variables(mapping_->Scopes, state_->pos, state_->reg, state);
-  add_callstack(*state_, mapping_, state);
+  add_variables(state_->program->mapping->Scopes, state_->pos, state_->reg, state);
+  add_callstack(*state_, state_->program->mapping, state);
 
   auto loc = get_location(state_->pos);
   if (loc != nullptr) {
@@ -250,6 +918,10 @@ int Runtime::Debug(int port) {
     auto debug_state = DebugState::ENTRY;
 
     while (state_->pos > -1) {
+      if (state_->pending != nullptr) {
+        state_->pending->Wait();
+        resume();
+      }
       // Process commands
       auto command = connection.get_command(debug_state == DebugState::PAUSED);
       if (command) switch (command->type()) {
@@ -277,7 +949,7 @@ int Runtime::Debug(int port) {
             break;
         }
 
-      int code = state_->program[state_->pos];
+      int code = state_->program->bytecode[state_->pos];
       auto loc = get_location(state_->pos);
       // Communicate
       switch (debug_state) {
@@ -28,8 +28,14 @@
 #ifndef CHARLIE_VM_RUNTIME_H
 #define CHARLIE_VM_RUNTIME_H
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <utility>
 
+#include "jit.h"
+#include "profiler.h"
+#include "sampler.h"
 #include "state.h"
 
 #include "../program/mapping.h"
@@ -39,14 +45,69 @@ class DebugConnection;
 
 class Runtime {
  public:
-  explicit Runtime(std::unique_ptr<State> state, std::shared_ptr<program::Mapping> mapping = nullptr);
-  int Run();
+  // The loops which are able to execute the bytecode.
+  enum class Engine {
+    // Calls the handler of each instruction from InstructionManager::Instructions
+    Table,
+    // Executes the instruction records decoded at load time inline in one loop.
+    // Skips the register bounds checks if the program passed the verifier.
+    Switch,
+    // Runs the records translated to native code. Falls back to Switch where native code is not supported or the
+    // program did not pass the verifier
+    Jit
+  };
+  // Result of a time slice
+  enum class Status {
+    // The program exited or returned from its entry function
+    Finished,
+    // The budget is used up. The next call of RunFor continues the program.
+    Suspended,
+    // The cancellation flag is set. The next call of RunFor continues the program, once the flag is cleared.
+    Cancelled,
+    // An instruction failed. The position of the state points to it.
+    Halted,
+    // The program waits for an asynchronous external function (State::pending). The next call of RunFor continues the
+    // program once the result is resolved.
+    Waiting
+  };
+  // Runs the program of "state". Debugging requires the program to have a source mapping.
+  explicit Runtime(std::unique_ptr<State> state);
+  // Runs the program with the specified engine and returns the value on top of the ALU stack.
+  // Blocks while the program waits for asynchronous external functions.
+  // If "profiler" or "sampler" is not null, the switch engine runs the program and reports to them.
+  // The sampler has to be started by the caller.
+  int Run(Engine engine = Engine::Switch, Profiler* profiler = nullptr, Sampler* sampler = nullptr);
+  // Runs the program with the switch engine for about "budget" instructions. The budget gets charged with each run of
+  // records between two branches when entering it, so a slice may exceed it by the length of one run.
+  // Each slice runs at least until the first branch. "cancel" gets polled every 65536 instructions.
+  Status RunFor(int64_t budget, std::atomic<bool> const* cancel = nullptr);
+  // Returns the value on top of the ALU stack
+  int GetResult() const;
+  inline State const& GetState() const { return *state_; }
+  // Hands the state back, e.g. to return it to a StatePool. The runtime must not be used afterwards.
+  inline std::unique_ptr<State> ReleaseState() { return std::move(state_); }
   int Debug(int port);
 
  private:
+  int run_engine(Engine engine, Profiler* profiler, Sampler* sampler);
+  // Pushes the resolved result of the pending external function
+  void resume();
+  int run_table();
+  // Runs switch_loop without checks if the program has been verified
+  int run_switch(Profiler* profiler = nullptr, Sampler* sampler = nullptr);
+  // Runs the variant of switch_loop which reports to the given probes only
+  template <bool kChecked>
+  int select_loop(Profiler* profiler, Sampler* sampler);
+  // "kBudget": Charges budget_ and suspends the program when it is used up
+  template <bool kChecked, bool kProfile, bool kSample, bool kBudget>
+  int switch_loop(Profiler* profiler, Sampler* sampler);
+  int run_jit();
   std::unique_ptr<State> state_;
-  std::shared_ptr<program::Mapping> mapping_;
-  program::Mapping::Location* get_location(int pos);
+  // Instruction budget of switch_loop with kBudget. Holds the remaining budget afterwards.
+  int64_t budget_;
+  // Whether switch_loop stopped because the budget was used up
+  bool suspended_;
+  const program::Mapping::Location* get_location(int pos);
   void send_event(int code, DebugConnection* connection, int reason);
 };
 }  // namespace charlie::vm
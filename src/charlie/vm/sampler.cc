@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "sampler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iterator>
+#include <map>
+#include <string>
+#include <utility>
+
+namespace charlie::vm {
+
+namespace {
+// Returns the name of the function containing the bytecode address
+std::string function_at(program::Mapping const &mapping, int address) {
+  for (auto const &function : mapping.Functions) {
+    if (function->scope.begin <= address && function->scope.end >= address) return function->name;
+  }
+  return "__global__";  // Initialisations beside the main() function
+}
+}  // namespace
+
+Sampler::Sampler(std::chrono::microseconds interval)
+    : interval_(interval),
+      pending_(false),
+      running_(false),
+      mutex_(),
+      wake_(),
+      thread_(),
+      nodes_(),
+      children_(),
+      count_(0) {}
+
+Sampler::~Sampler() { Stop(); }
+
+void Sampler::Start() {
+  if (thread_.joinable()) return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = true;
+  }
+  thread_ = std::thread(&Sampler::run, this);
+}
+
+void Sampler::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  wake_.notify_all();
+  if (thread_.joinable()) thread_.join();
+  pending_.store(false, std::memory_order_relaxed);
+}
+
+void Sampler::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!wake_.wait_for(lock, interval_, [this] { return !running_; })) {
+    pending_.store(true, std::memory_order_relaxed);
+  }
+}
+
+void Sampler::Take(int pos, Stack const &call_stack) {
+  const int *begin = call_stack.BottomPointer();
+  const int *end = call_stack.TopPointer();
+  int node = -1;
+  if (end - begin > kMaxFrames - 1) {
+    begin = end - (kMaxFrames - 1);
+    node = intern(node, -1);
+  }
+  // Return addresses point behind the Call
+  for (const int *frame = begin; frame != end; ++frame) node = intern(node, *frame - 1);
+  node = intern(node, pos);
+  ++nodes_[node].count;
+  ++count_;
+  // Requests made while taking the sample get dropped. Otherwise a slow sample would be followed by another one.
+  pending_.store(false, std::memory_order_relaxed);
+}
+
+int Sampler::intern(int parent, int address) {
+  const uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(parent)) << 32) | static_cast<uint32_t>(address);
+  auto it = children_.find(key);
+  if (it != children_.end()) return it->second;
+  const int node = static_cast<int>(nodes_.size());
+  nodes_.push_back({parent, address, 0});
+  children_.emplace(key, node);
+  return node;
+}
+
+std::vector<int> Sampler::frames_of(int node) const {
+  std::vector<int> frames;
+  for (; node > -1; node = nodes_[node].parent) frames.push_back(nodes_[node].address);
+  std::reverse(frames.begin(), frames.end());
+  return frames;
+}
+
+void Sampler::WriteFolded(program::Mapping const &mapping, std::ostream *out) const {
+  std::map<std::string, uint64_t> folded;
+  for (int node = 0; node < static_cast<int>(nodes_.size()); ++node) {
+    if (nodes_[node].count == 0) continue;
+    std::string frames;
+    for (int address : frames_of(node)) {
+      if (!frames.empty()) frames += ';';
+      frames += address < 0 ? "[truncated]" : function_at(mapping, address);
+    }
+    folded[frames] += nodes_[node].count;
+  }
+  for (auto const &line : folded) *out << line.first << ' ' << line.second << '\n';
+}
+
+void Sampler::ReportLines(program::Mapping const &mapping, std::ostream *out, int limit) const {
+  if (count_ == 0) return;
+  // The statements in the order of their first instruction
+  std::map<int, int> statements;
+  for (auto const &instruction : mapping.Instructions) statements[instruction.first] = instruction.second.line;
+
+  // Count the samples of the innermost frame by the statement it belongs to
+  std::map<int, uint64_t> hits;
+  std::map<int, std::string> functions;
+  for (auto const &node : nodes_) {
+    if (node.count == 0) continue;
+    const int address = node.address;
+    auto statement = statements.upper_bound(address);
+    const int line = statement == statements.begin() ? 0 : std::prev(statement)->second;
+    hits[line] += node.count;
+    if (functions.count(line) == 0) functions[line] = function_at(mapping, address);
+  }
+  std::vector<std::pair<int, uint64_t>> lines(hits.begin(), hits.end());
+  std::sort(lines.begin(), lines.end(),
+            [](std::pair<int, uint64_t> const &a, std::pair<int, uint64_t> const &b) { return a.second > b.second; });
+  if (static_cast<int>(lines.size()) > limit) lines.resize(std::max(limit, 0));
+
+  const auto flags = out->flags();
+  const auto precision = out->precision();
+  *out << "Samples: " << count_ << "\n\n";
+  *out << std::setw(8) << "Line" << std::setw(10) << "Samples" << std::setw(8) << "%"
+       << "  Function\n";
+  *out << std::fixed << std::setprecision(1);
+  for (auto const &line : lines) {
+    // Instructions in front of the first statement of the program have no line
+    if (line.first > 0) {
+      *out << std::setw(8) << line.first;
+    } else {
+      *out << std::setw(8) << "-";
+    }
+    *out << std::setw(10) << line.second << std::setw(8)
+         << 100.0 * line.second / count_ << "  " << functions[line.first] << "\n";
+  }
+  out->flags(flags);
+  out->precision(precision);
+}
+
+}  // namespace charlie::vm
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef CHARLIE_VM_SAMPLER_H
+#define CHARLIE_VM_SAMPLER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "stack.h"
+
+#include "../program/mapping.h"
+
+namespace charlie::vm {
+
+// Sampling profiler: A timer thread requests a sample periodically. The engine polls the request on jumps, calls and
+// returns and hands over the bytecode address where it continues and the return addresses on the call stack. Unlike
+// the Profiler it does not look at every instruction, which keeps the overhead low enough to leave it on.
+// The samples get symbolised through the source mapping of the program.
+class Sampler {
+ public:
+  // "interval": Time between two samples
+  explicit Sampler(std::chrono::microseconds interval = std::chrono::microseconds(1000));
+  ~Sampler();
+  Sampler(const Sampler &) = delete;
+  Sampler &operator=(const Sampler &) = delete;
+  // Starts and stops the timer thread. Samples taken before are kept.
+  void Start();
+  void Stop();
+  // Returns the flag which is set when the engine should take a sample.
+  inline std::atomic<bool> const *PendingFlag() const { return &pending_; }
+  // Records the address of the current instruction and the return addresses of the call stack. Only the innermost
+  // kMaxFrames frames get recorded, so the cost of a sample does not grow with the depth of a recursion.
+  void Take(int pos, Stack const &call_stack);
+  // Returns the number of samples taken.
+  inline uint64_t GetCount() const { return count_; }
+  // Writes one line per distinct call stack in the folded format of Brendan Gregg's flamegraph.pl:
+  // The function names from the outermost to the innermost separated by semicolons followed by the number of samples.
+  void WriteFolded(program::Mapping const &mapping, std::ostream *out) const;
+  // Prints the source lines which got the most samples.
+  // "limit": Maximal number of lines to print
+  void ReportLines(program::Mapping const &mapping, std::ostream *out, int limit = 20) const;
+
+ private:
+  // Frame of the recorded call stacks. The stacks share their common outer frames.
+  struct Node {
+    // Index of the calling frame or -1 for the outermost one
+    int parent;
+    // Address of the instruction. -1 stands for the frames left out beyond kMaxFrames.
+    int address;
+    // Number of samples whose innermost frame this is
+    uint64_t count;
+  };
+  static constexpr int kMaxFrames = 128;
+
+  void run();
+  // Returns the index of the frame at "address" called from "parent". Adds it if it is new.
+  int intern(int parent, int address);
+  // Returns the addresses of the frames from the outermost to the node
+  std::vector<int> frames_of(int node) const;
+
+  std::chrono::microseconds interval_;
+  std::atomic<bool> pending_;
+  bool running_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::thread thread_;
+  std::vector<Node> nodes_;
+  // Index of each node by its parent (upper half) and address (lower half)
+  std::unordered_map<uint64_t, int> children_;
+  uint64_t count_;
+};
+
+}  // namespace charlie::vm
+
+#endif  // !CHARLIE_VM_SAMPLER_H
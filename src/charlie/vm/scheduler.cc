@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "scheduler.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace charlie::vm {
+
+Scheduler::Scheduler(int threads, int64_t slice)
+    : slice_(slice),
+      cancelled_(false),
+      mutex_(),
+      ready_(),
+      idle_(),
+      queue_(),
+      pending_(0),
+      stopping_(false),
+      workers_() {
+  if (threads < 1) threads = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+  for (int i = 0; i < threads; ++i) workers_.emplace_back(&Scheduler::work, this);
+}
+
+Scheduler::~Scheduler() {
+  Cancel();
+  // Parked instances continue once their results are resolved
+  Wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  ready_.notify_all();
+  for (auto &worker : workers_) worker.join();
+}
+
+std::future<Scheduler::Result> Scheduler::Submit(std::unique_ptr<State> state) {
+  Task task;
+  task.runtime = std::make_unique<Runtime>(std::move(state));
+  auto result = task.promise.get_future();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(task));
+    ++pending_;
+  }
+  ready_.notify_one();
+  return result;
+}
+
+void Scheduler::Cancel() { cancelled_ = true; }
+
+void Scheduler::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_.wait(lock, [this]() { return pending_ == 0; });
+}
+
+void Scheduler::work() {
+  for (;;) {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+      // The queue gets drained before shutting down
+      if (queue_.empty()) return;
+      task = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    auto status = task.runtime->RunFor(slice_, &cancelled_);
+    if (status == Runtime::Status::Suspended) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back(std::move(task));
+      continue;
+    }
+    if (status == Runtime::Status::Waiting) {
+      park(std::move(task));
+      continue;
+    }
+    task.promise.set_value({status, task.runtime->GetResult()});
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--pending_ == 0) idle_.notify_all();
+  }
+}
+
+void Scheduler::park(Task task) {
+  auto pending = task.runtime->GetState().pending;
+  auto parked = std::make_shared<Task>(std::move(task));
+  // Called on the resolving thread or right away if the result is resolved already
+  pending->OnResolved([this, parked]() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(*parked));
+    // Under the lock: Afterwards the scheduler may be gone
+    ready_.notify_one();
+  });
+}
+
+}  // namespace charlie::vm
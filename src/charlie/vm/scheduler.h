@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef CHARLIE_VM_SCHEDULER_H
+#define CHARLIE_VM_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "runtime.h"
+#include "state.h"
+
+namespace charlie::vm {
+
+// Multiplexes any number of program instances over a small pool of threads. A worker takes the instance at the front
+// of the queue, runs it for one slice and queues it again at the back if it did not stop. So a long running script
+// delays the others by at most one slice per worker instead of occupying a thread until it is done.
+// Instances waiting for an asynchronous external function leave the queue until the result is resolved.
+class Scheduler {
+ public:
+  struct Result {
+    Runtime::Status status;
+    // Value on top of the ALU stack when the instance stopped
+    int value;
+  };
+  // "threads": Number of worker threads. Uses one per hardware thread if less than one.
+  // "slice": Instruction budget of an instance per turn
+  explicit Scheduler(int threads = 0, int64_t slice = 10000);
+  // Cancels the remaining instances and joins the workers. Waits for the results parked instances are waiting for.
+  ~Scheduler();
+  Scheduler(const Scheduler &) = delete;
+  Scheduler &operator=(const Scheduler &) = delete;
+  // Queues an instance. The future gets its result once the program stopped.
+  std::future<Result> Submit(std::unique_ptr<State> state);
+  // Stops the running instances at the latest after their current slice. They and all instances submitted afterwards
+  // finish with the status Cancelled.
+  void Cancel();
+  // Blocks until all submitted instances stopped.
+  void Wait();
+  inline int GetThreadCount() const { return static_cast<int>(workers_.size()); }
+
+ private:
+  struct Task {
+    std::unique_ptr<Runtime> runtime;
+    std::promise<Result> promise;
+  };
+  void work();
+  // Queues the task again once the result it waits for is resolved
+  void park(Task task);
+
+  int64_t slice_;
+  std::atomic<bool> cancelled_;
+  std::mutex mutex_;
+  // Signals a queued task or the shutdown to the workers
+  std::condition_variable ready_;
+  // Signals that no task is left
+  std::condition_variable idle_;
+  std::deque<Task> queue_;
+  // Number of submitted tasks which did not stop yet
+  int pending_;
+  bool stopping_;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace charlie::vm
+
+#endif  // !CHARLIE_VM_SCHEDULER_H
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "stack.h"
+
+#include <memory.h>
+#include <algorithm>
+
+namespace charlie::vm {
+
+Stack::Stack() : data_(nullptr), top_(nullptr), end_(nullptr) {}
+
+Stack::Stack(const Stack &other) : data_(nullptr), top_(nullptr), end_(nullptr) { *this = other; }
+
+Stack &Stack::operator=(const Stack &other) {
+  if (this == &other) return *this;
+  const int size = static_cast<int>(other.size());
+  top_ = data_;
+  Reserve(size);
+  if (size > 0) memcpy(data_, other.data_, sizeof(int) * size);
+  top_ = data_ + size;
+  return *this;
+}
+
+Stack::~Stack() {
+  if (data_ != nullptr) {
+    delete[] data_;
+    data_ = nullptr;
+  }
+}
+
+void Stack::grow(int count) {
+  const int size = static_cast<int>(top_ - data_);
+  const int capacity = std::max(std::max(size + count, 2 * static_cast<int>(end_ - data_)), 64);
+  int *data = new int[capacity];
+  if (size > 0) memcpy(data, data_, sizeof(int) * size);
+  delete[] data_;
+  data_ = data;
+  top_ = data_ + size;
+  end_ = data_ + capacity;
+}
+
+}  // namespace charlie::vm
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef CHARLIE_VM_STACK_H
+#define CHARLIE_VM_STACK_H
+
+#include <cstddef>
+
+namespace charlie::vm {
+
+// Contiguous stack of integers with a raw top pointer.
+// Offers the interface of std::stack<int> which is used by the instructions and the external functions.
+// The engines reserve the depth which the compiler calculated and then work directly on the pointer.
+class Stack {
+ public:
+  Stack();
+  Stack(const Stack &other);
+  Stack &operator=(const Stack &other);
+  ~Stack();
+  // Pushes the value and grows the memory if needed.
+  inline void push(int value) {
+    if (top_ == end_) grow(1);
+    *top_++ = value;
+  }
+  // Removes the top value. The stack must not be empty.
+  inline void pop() { --top_; }
+  // Returns the top value. The stack must not be empty.
+  inline int &top() { return top_[-1]; }
+  inline int top() const { return top_[-1]; }
+  inline bool empty() const { return top_ == data_; }
+  inline size_t size() const { return static_cast<size_t>(top_ - data_); }
+  // Removes all values and keeps the memory.
+  inline void clear() { top_ = data_; }
+  // Makes sure that "count" more values can be pushed without reallocation.
+  // Invalidates pointers got from TopPointer() if the memory has to grow.
+  inline void Reserve(int count) {
+    if (end_ - top_ < count) grow(count);
+  }
+  // Returns the pointer to the bottom value.
+  inline int *BottomPointer() const { return data_; }
+  // Returns the pointer behind the top value.
+  inline int *TopPointer() const { return top_; }
+  // Sets the pointer behind the top value. Used by the engines to write back their local copy.
+  inline void SetTopPointer(int *top) { top_ = top; }
+  // Returns the pointer behind the allocated memory.
+  inline int *EndPointer() const { return end_; }
+
+ private:
+  // Reallocates the memory to fit at least "count" more values.
+  void grow(int count);
+
+  int *data_;
+  int *top_;
+  int *end_;
+};
+
+}  // namespace charlie::vm
+
+#endif  // !CHARLIE_VM_STACK_H
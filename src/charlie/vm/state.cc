@@ -27,11 +27,24 @@
 
 #include "instruction.h"
 
+#include <utility>
+
 
 namespace charlie {
 namespace vm {
 
-State::State() : alu_stack(), call_stack(), reg(), program(), pos(0), external_function_manager(nullptr) {}
+State::State(std::shared_ptr<const Program> program)
+    : alu_stack(), call_stack(), reg(), program(std::move(program)), pos(0), pending() {
+  if (this->program != nullptr) alu_stack.Reserve(this->program->GetMaxStackDepth());
+}
+
+void State::Reset() {
+  alu_stack.clear();
+  call_stack.clear();
+  reg.Reset();
+  pos = 0;
+  pending.reset();
+}
 
 }  // namespace vm
 }  // namespace charlie
\ No newline at end of file
@@ -29,12 +29,13 @@
 #ifndef CHARLIE_VM_STATE_H
 #define CHARLIE_VM_STATE_H
 
+#include <memory>
 #include <vector>
 #include <stack>
 
+#include "program.h"
 #include "register.h"
-
-#include "../api/external_function_manager.h"
+#include "stack.h"
 
 namespace charlie {
 namespace vm {
@@ -49,22 +50,25 @@ struct State {
     // position to continue
     int pos;
   };
-  // Creates an object
-  State();
+  // Creates an object which runs the program from the beginning
+  explicit State(std::shared_ptr<const Program> program = nullptr);
+  // Rewinds the state to the beginning of the program. Keeps the memory of the stacks and the register.
+  void Reset();
   // The ALU stack is used for current calculations.
-  std::stack<int> alu_stack;
+  Stack alu_stack;
   // Stores each position where a currently running function call was made.
   // Need to jump back, when the function finished.
-  std::stack<int> call_stack;
+  Stack call_stack;
   // Register stores all current variables.
   //std::vector<int> reg;
   Register reg;
-  // The bytecode of the program.
-  std::vector<int> program;
+  // The program. Shared with all other states running it.
+  std::shared_ptr<const Program> program;
   // The current position in the programs bytecode.
   int pos;
-  // Pointer to the external function manager.
-  const api::ExternalFunctionManager *external_function_manager;
+  // Result of the asynchronous external function the program waits for. Its image gets pushed onto the ALU stack
+  // before the program continues at "pos". Null if the program is not waiting.
+  std::shared_ptr<api::PendingResult> pending;
 };
 
 }  // namespace vm
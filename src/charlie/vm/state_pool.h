@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef CHARLIE_VM_STATE_POOL_H
+#define CHARLIE_VM_STATE_POOL_H
+
+#include <memory>
+#include <vector>
+
+#include "program.h"
+#include "state.h"
+
+namespace charlie::vm {
+
+// Hands out states of one program which keep the memory of their stacks and register between runs, so running many
+// short instances allocates nothing once the pool is warm.
+// Not synchronised: Each thread uses its own pool.
+class StatePool {
+ public:
+  explicit StatePool(std::shared_ptr<const Program> program);
+  StatePool(const StatePool &) = delete;
+  StatePool &operator=(const StatePool &) = delete;
+  // Returns a state at the beginning of the program. Reuses a released state if there is one.
+  std::unique_ptr<State> Acquire();
+  // Takes a state of the program back for reuse.
+  void Release(std::unique_ptr<State> state);
+  // Returns the number of states waiting for reuse.
+  inline size_t GetFreeCount() const { return free_.size(); }
+
+ private:
+  std::shared_ptr<const Program> program_;
+  std::vector<std::unique_ptr<State>> free_;
+};
+
+}  // namespace charlie::vm
+
+#endif  // !CHARLIE_VM_STATE_POOL_H
@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "verifier.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "instruction.h"
+
+namespace charlie::vm {
+
+namespace {
+
+// Effect of a function on the ALU stack. Depths are relative to the entry of the function.
+struct Summary {
+  // Whether a Return of the function has been reached
+  bool returns;
+  // Depth when returning
+  int result;
+  // Lowest and highest depth of the function and the functions it calls
+  int lowest;
+  int highest;
+  bool operator!=(Summary const& other) const {
+    return returns != other.returns || result != other.result || lowest != other.lowest || highest != other.highest;
+  }
+};
+
+// What is known in front of a record
+struct Entry {
+  bool reached;
+  // Depth of the ALU stack
+  int depth;
+  // Sizes of the scopes the function opened
+  std::vector<int> scopes;
+};
+
+// Returns the number of values the instruction pops from the ALU stack before pushing its result.
+int popped_values(int code) {
+  if ((code >= InstructionEnums::IntAdd && code <= InstructionEnums::IntModulo) ||
+      (code >= InstructionEnums::IntEqual && code <= InstructionEnums::IntLessEqual))
+    return 2;
+  const int effect = InstructionManager::GetStackEffect(code);
+  return effect < 0 ? -effect : 0;
+}
+
+class Verifier {
+ public:
+  Verifier(DecodedProgram const& program, api::ExternalFunctionManager const* external_functions)
+      : records_(program.instructions), external_functions_(external_functions), globals_(0), functions_() {}
+
+  bool Run(int* stack_depth) {
+    if (records_.empty() || records_[0].code != InstructionEnums::IncreaseRegister || records_[0].operand < 0)
+      return false;
+    globals_ = records_[0].operand;
+    functions_[0] = {false, 0, 0, 0};
+
+    // A call cuts the path until the called function is known to return. Walk all functions again until the
+    // summaries do not change anymore. Calls which dig deeper into the stack with each recursion never settle.
+    for (size_t round = 0;; ++round) {
+      if (round > 2 * functions_.size() + 2) return false;
+      bool changed = false;
+      const size_t known = functions_.size();
+      for (auto it = functions_.begin(); it != functions_.end(); ++it) {
+        Summary before = it->second;
+        if (!walk(it->first, &it->second)) return false;
+        if (it->second != before) changed = true;
+      }
+      if (!changed && functions_.size() == known) break;
+    }
+
+    // The program itself begins with an empty stack
+    if (functions_[0].lowest < 0) return false;
+    int depth = 0;
+    for (auto const& function : functions_) depth = std::max(depth, function.second.highest - function.second.lowest);
+    *stack_depth = depth;
+    return true;
+  }
+
+ private:
+  // Walks all records which are reachable from the entry of the function. Returns false on a violation.
+  bool walk(int function, Summary* summary) {
+    const int size = static_cast<int>(records_.size());
+    std::vector<Entry> entries(size, {false, 0, {}});
+    std::vector<int> pending;
+
+    // Propagates the state to the record. Returns false if the record was reached with a different state before.
+    auto follow = [&](int index, Entry const& state) {
+      if (index < 0 || index >= size) return false;
+      Entry& entry = entries[index];
+      if (!entry.reached) {
+        entry = state;
+        pending.push_back(index);
+        return true;
+      }
+      return entry.depth == state.depth && entry.scopes == state.scopes;
+    };
+
+    // The first record of the program opens the global scope
+    if (!follow(function == 0 ? 1 : function, {true, 0, {}})) return false;
+
+    while (!pending.empty()) {
+      const int index = pending.back();
+      pending.pop_back();
+      const DecodedInstruction& record = records_[index];
+      Entry state = entries[index];
+
+      int frame = globals_;
+      for (int scope : state.scopes) frame += scope;
+      const int mask = InstructionManager::GetRegisterOperands(record.code);
+      const int operands[] = {record.operand, record.operand2, record.operand3};
+      for (int i = 0; i < 3; ++i) {
+        if ((mask & (1 << i)) && (operands[i] < 0 || operands[i] >= frame)) return false;
+      }
+
+      const int next = index + 1;
+      switch (record.code) {
+        case InstructionEnums::IncreaseRegister:
+          if (record.operand < 0) return false;
+          state.scopes.push_back(record.operand);
+          if (!follow(next, state)) return false;
+          break;
+        case InstructionEnums::DecreaseRegister:
+          if (state.scopes.empty()) return false;
+          state.scopes.pop_back();
+          if (!follow(next, state)) return false;
+          break;
+        case InstructionEnums::Call: {
+          if (record.operand <= 0 || record.operand >= size) return false;
+          auto callee = functions_.find(record.operand);
+          if (callee == functions_.end()) {
+            functions_[record.operand] = {false, 0, 0, 0};
+            break;
+          }
+          // Nothing follows until the function is known to return
+          if (!callee->second.returns) break;
+          summary->lowest = std::min(summary->lowest, state.depth + callee->second.lowest);
+          state.depth += callee->second.result;
+          summary->highest = std::max(summary->highest, state.depth);
+          if (!follow(next, state)) return false;
+          break;
+        }
+        case InstructionEnums::CallEx: {
+          // Invoke ignores unknown ids
+          int count = external_functions_ != nullptr ? external_functions_->GetArgumentCount(record.operand) : 0;
+          state.depth -= std::max(count, 0);
+          summary->lowest = std::min(summary->lowest, state.depth);
+          if (external_functions_ != nullptr &&
+              external_functions_->GetImageType(record.operand) != program::VariableDeclaration::Void) {
+            state.depth += 1;
+            summary->highest = std::max(summary->highest, state.depth);
+          }
+          if (!follow(next, state)) return false;
+          break;
+        }
+        case InstructionEnums::Jump:
+          if (!follow(record.operand, state)) return false;
+          break;
+        case InstructionEnums::JumpIf:
+          // The else address must not come from the stack
+          if (record.operand < 0) return false;
+          state.depth -= 1;
+          summary->lowest = std::min(summary->lowest, state.depth);
+          if (!follow(next, state) || !follow(record.operand, state)) return false;
+          break;
+        case InstructionEnums::TailCall: {
+          if (record.operand <= 0 || record.operand >= size) return false;
+          auto callee = functions_.find(record.operand);
+          if (callee == functions_.end()) {
+            functions_[record.operand] = {false, 0, 0, 0};
+            break;
+          }
+          // Returns with the result of the callee once it is known to return
+          if (!callee->second.returns) break;
+          summary->lowest = std::min(summary->lowest, state.depth + callee->second.lowest);
+          summary->highest = std::max(summary->highest, state.depth + callee->second.highest);
+          if (!returns(state.depth + callee->second.result, summary)) return false;
+          break;
+        }
+        case InstructionEnums::Return:
+          if (!returns(state.depth, summary)) return false;
+          break;
+        case InstructionEnums::Exit:
+          break;
+        default: {
+          const int popped = popped_values(record.code);
+          state.depth -= popped;
+          summary->lowest = std::min(summary->lowest, state.depth);
+          state.depth += popped + InstructionManager::GetStackEffect(record.code);
+          summary->highest = std::max(summary->highest, state.depth);
+          if (!follow(next, state)) return false;
+          const int target = InstructionManager::GetTargetOperand(record.code);
+          if (target > -1 && !follow(operands[target], state)) return false;
+          break;
+        }
+      }
+    }
+    return true;
+  }
+
+  // Records the depth at a return of the function. Returns false if it differs from the depth at another return.
+  static bool returns(int depth, Summary* summary) {
+    if (!summary->returns) {
+      summary->returns = true;
+      summary->result = depth;
+      return true;
+    }
+    return summary->result == depth;
+  }
+
+  std::vector<DecodedInstruction> const& records_;
+  api::ExternalFunctionManager const* external_functions_;
+  // Number of global variables
+  int globals_;
+  // Summaries of the program (index 0) and each called function by the index of their first record
+  std::map<int, Summary> functions_;
+};
+
+}  // namespace
+
+bool VerifyProgram(DecodedProgram const& program, api::ExternalFunctionManager const* external_functions,
+                   int* stack_depth) {
+  Verifier verifier(program, external_functions);
+  return verifier.Run(stack_depth);
+}
+
+}  // namespace charlie::vm
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2016, Matthias Lochbrunner <matthias_lochbrunner@live.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef CHARLIE_VM_VERIFIER_H
+#define CHARLIE_VM_VERIFIER_H
+
+#include "decoded_program.h"
+
+#include "../api/external_function_manager.h"
+
+namespace charlie::vm {
+
+// Proves at load time that the decoded program can run without checks:
+// - The first record opens the global scope.
+// - Register addresses lie within the globals and the scopes the current function opened.
+// - Every scope that gets closed was opened by the same function.
+// - The ALU stack never drops below the values the caller passed and has the same depth and the same open scopes
+//   on every path into a record.
+// - Jumps have constant targets. Decode already made sure that all targets are instruction beginnings.
+// "external_functions" may be null. CallEx then has no effect like in the engines.
+// "stack_depth" receives the number of values the stack of one function grows between its lowest and highest point.
+// Returns false if one of the properties could not be proven.
+bool VerifyProgram(DecodedProgram const &program, api::ExternalFunctionManager const *external_functions,
+                   int *stack_depth);
+
+}  // namespace charlie::vm
+
+#endif  // !CHARLIE_VM_VERIFIER_H
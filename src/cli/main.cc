@@ -25,8 +25,13 @@
  * SUCH DAMAGE.
  */
 
+#include <chrono>
+#include <fstream>
+#include <future>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 
 #include <boost/program_options.hpp>
@@ -35,7 +40,9 @@
 
 #include "common/comparer_string.h"
 #include "compiler.h"
+#include "vm/batch.h"
 #include "vm/runtime.h"
+#include "vm/scheduler.h"
 
 using std::cerr;
 using std::cout;
@@ -46,21 +53,28 @@ using charlie::Compiler;
 
 namespace po = boost::program_options;
 
+// Guards the console and the log against instances running in parallel
+std::mutex output_mutex;
+
 // Adds console output functions to the compiler
 void addExternalFunctions(Compiler *compiler) {
   compiler->external_function_manager.AddFunction("print", [](const char *message) {
+    std::lock_guard<std::mutex> lock(output_mutex);
     cout << message;
     Log::buffer << message;
   });
   compiler->external_function_manager.AddFunction("println", [](const char *message) {
+    std::lock_guard<std::mutex> lock(output_mutex);
     cout << message << endl;
     Log::buffer << message << endl;
   });
   compiler->external_function_manager.AddFunction("println", [](int number) {
+    std::lock_guard<std::mutex> lock(output_mutex);
     cout << number << endl;
     Log::buffer << number << endl;
   });
   compiler->external_function_manager.AddFunction("print", [](int number) {
+    std::lock_guard<std::mutex> lock(output_mutex);
     cout << number;
     Log::buffer << number;
   });
@@ -95,6 +109,23 @@ int main(int argn, char **argv) {
       ("ascii,a", "saves the program in ascii format")
       ("binary,b", "saves the program in binary format")
       ("debug", po::value<int>() ,"Debug mode")
+      ("engine", po::value<std::string>()->default_value("switch"), "Execution engine: switch or table")
+      ("jit", "translates the program to native code before running it")
+      ("stack-only", "emits no register instructions")
+      ("no-fold", "does not fold constant expressions")
+      ("no-peephole", "does not fuse instruction sequences")
+      ("no-ssa", "generates the code from the syntax tree instead of the SSA form")
+      ("dump-ir", "prints the SSA form of each function")
+      ("inline", po::value<int>()->default_value(32), "inlines functions up to this many bytecode words. 0: never")
+      ("evaluate", po::value<int>()->default_value(1 << 16),
+       "evaluates calls of pure functions with constant arguments at build time for up to this many instructions. 0: never")
+      ("jobs,j", po::value<int>()->default_value(0), "number of threads compiling the functions. 0: all cores")
+      ("profile", "counts the executed instructions and prints the hottest ones")
+      ("sample", po::value<std::string>(), "samples the call stack and writes it as folded stacks to the file")
+      ("instances", po::value<int>()->default_value(1), "runs the program this many times sharing one image")
+      ("threads", po::value<int>()->default_value(0), "number of threads running the instances. 0: all cores")
+      ("slice", po::value<int64_t>()->default_value(0),
+       "instructions an instance runs before the next one gets its turn. 0: runs each instance to the end")
       // ("debug-port", po::value<int>() ,"Debug mode <port>")
       ("file", po::value<std::string>(), "Arguments for command");
     // clang-format on
@@ -111,8 +142,19 @@ int main(int argn, char **argv) {
     Compiler compiler([](string const &message) { cerr << message << endl; });
 
     addExternalFunctions(&compiler);
+    compiler.options.register_instructions = vm.count("stack-only") == 0;
+    compiler.options.fold_constants = vm.count("no-fold") == 0;
+    compiler.options.peephole = vm.count("no-peephole") == 0;
+    compiler.options.inline_size = vm["inline"].as<int>();
+    compiler.options.evaluation_budget = vm["evaluate"].as<int>();
+    compiler.options.threads = vm["jobs"].as<int>();
+    compiler.options.ssa = vm.count("no-ssa") == 0;
+    if (vm.count("dump-ir") > 0) compiler.options.ir_dump = &cout;
     bool debug = vm.count("debug") > 0;
-    if (compiler.Build(file, debug)) {
+    bool sample = vm.count("sample") > 0;
+    // The samples get symbolised through the source mapping, which keeps the code of a normal run unless debugging
+    compiler.options.map_variables = debug;
+    if (compiler.Build(file, debug || sample)) {
       if (vm.count("ascii") > 0) {
         if (compiler.SaveProgram(file, false, debug)) cerr << "Saving program to " << file << ".bc.txt" << endl;
       }
@@ -121,13 +163,81 @@ int main(int argn, char **argv) {
       }
       cerr << "Running program ..\n\n";
 
-      charlie::vm::Runtime runtime(compiler.GetProgram(), compiler.GetMapping());
       int result;
+      auto engine = vm["engine"].as<std::string>() == "table" ? charlie::vm::Runtime::Engine::Table
+                                                               : charlie::vm::Runtime::Engine::Switch;
+      if (vm.count("jit") > 0) engine = charlie::vm::Runtime::Engine::Jit;
+      const int instances = vm["instances"].as<int>();
+      const int64_t slice = vm["slice"].as<int64_t>();
+      if ((instances > 1 || slice > 0) && !debug) {
+        auto program = compiler.CreateProgram();
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<int> results;
+        int threads;
+        if (slice > 0) {
+          // Time sliced on the switch engine
+          charlie::vm::Scheduler scheduler(vm["threads"].as<int>(), slice);
+          std::vector<std::future<charlie::vm::Scheduler::Result>> futures;
+          for (int i = 0; i < instances; ++i) {
+            futures.push_back(scheduler.Submit(std::make_unique<charlie::vm::State>(program)));
+          }
+          for (auto &future : futures) results.push_back(future.get().value);
+          threads = scheduler.GetThreadCount();
+        } else {
+          charlie::vm::BatchRunner batch(program, vm["threads"].as<int>());
+          results = batch.Run(instances, engine);
+          threads = batch.GetThreadCount();
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin);
+        cerr << "\n\nRan " << instances << " instances on " << threads << " threads in " << elapsed.count() << " ms"
+             << endl;
+        // Report the first failing instance
+        result = 0;
+        for (int r : results) {
+          if (r != 0) {
+            result = r;
+            break;
+          }
+        }
+        if (vm.count("log") > 0) Log::Save(file);
+        if (result != 0) cerr << "Program exited with " << result << endl;
+        return result;
+      }
+
+      charlie::vm::Runtime runtime(compiler.GetProgram());
       if (debug) {
         result = runtime.Debug(vm["debug"].as<int>());
         // result = runtime.Debug(3232);
       } else {
-        result = runtime.Run();
+        std::unique_ptr<charlie::vm::Profiler> profiler;
+        std::unique_ptr<charlie::vm::Sampler> sampler;
+        if (vm.count("profile") > 0) profiler = std::make_unique<charlie::vm::Profiler>();
+        if (sample) {
+          sampler = std::make_unique<charlie::vm::Sampler>();
+          sampler->Start();
+        }
+        result = runtime.Run(engine, profiler.get(), sampler.get());
+        // An instruction failed, e.g. a division by zero
+        if (runtime.GetState().pos > -1) {
+          cerr << "\n\nProgram halted at bytecode address " << runtime.GetState().pos << endl;
+          result = -1;
+        }
+        if (profiler != nullptr) {
+          cerr << "\n\n";
+          profiler->Report(&cerr);
+        }
+        if (sampler != nullptr) {
+          sampler->Stop();
+          auto filename = vm["sample"].as<std::string>();
+          std::ofstream folded(filename);
+          if (folded.is_open()) {
+            sampler->WriteFolded(*compiler.GetMapping(), &folded);
+            cerr << "\n\nSaving folded stacks to " << filename << endl;
+          } else {
+            cerr << "\n\nCan not write folded stacks to " << filename << endl;
+          }
+          sampler->ReportLines(*compiler.GetMapping(), &cerr);
+        }
       }
       cerr << endl;
       if (vm.count("log") > 0) Log::Save(file);
@@ -25,16 +25,102 @@
  * SUCH DAMAGE.
  */
 
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
 #include "compiler.h"
 #include "gtest/gtest.h"
 #include "scanner.h"
 
+#include "program/constant_folding.h"
+#include "program/dead_code.h"
+#include "program/ir/builder.h"
+#include "program/ir/passes.h"
+#include "program/peephole.h"
 #include "program/unresolved_program.h"
 
 #include "api/external_function_manager.h"
 
+#include "vm/decoded_program.h"
+#include "vm/instruction.h"
+#include "vm/runtime.h"
+#include "vm/scheduler.h"
+#include "vm/state_pool.h"
+#include "vm/verifier.h"
+
 namespace charlie {
 
+namespace {
+// Returns the first call of the function in the tree of the statement or nullptr
+program::Statement const *find_call(program::Statement const &statement, std::string const &name) {
+  auto label = dynamic_cast<token::Label const *>(statement.value);
+  if (label != nullptr && label->kind == token::Label::KindEnum::Function && label->label_string == name)
+    return &statement;
+  for (auto const &argument : statement.arguments) {
+    auto call = find_call(argument, name);
+    if (call != nullptr) return call;
+  }
+  return nullptr;
+}
+
+// Whether the block can be reached again from its successors
+bool in_loop(program::ir::Block const *block) {
+  std::set<program::ir::Block const *> visited;
+  auto successors = block->Successors();
+  std::vector<program::ir::Block const *> pending(successors.begin(), successors.end());
+  while (!pending.empty()) {
+    auto next = pending.back();
+    pending.pop_back();
+    if (next == block) return true;
+    if (!visited.insert(next).second) continue;
+    for (auto successor : next->Successors()) pending.push_back(successor);
+  }
+  return false;
+}
+
+// Counts the multiplications inside and outside of loops
+void count_multiplications(program::ir::Function const &function, int *inside, int *outside) {
+  *inside = *outside = 0;
+  for (auto const &block : function.blocks) {
+    for (auto const &instruction : block.instructions) {
+      if (instruction.opcode == program::ir::Opcode::Multiply) ++*(in_loop(&block) ? inside : outside);
+    }
+  }
+}
+
+// s = sum of i * k + n * 4 for i = 0 ... n - 1
+const char *const kLoop =
+    "\n\n"
+    "int f(int n, int k) { int s = 0; int i = 0; while (i < n) { s = s + i * k + n * 4; i = i + 1; } return s; }\n"
+    "int main() { return f(10, 3); }";
+
+// Counts the calls of internal functions in the bytecode
+int count_calls(std::vector<int> const &bytecode) {
+  int calls = 0;
+  for (size_t pos = 0; pos < bytecode.size(); pos += vm::InstructionManager::GetOperandCount(bytecode[pos]) + 1) {
+    if (bytecode[pos] == vm::InstructionEnums::Call || bytecode[pos] == vm::InstructionEnums::TailCall) ++calls;
+  }
+  return calls;
+}
+
+// Builds the SSA form of the first function of the code
+std::unique_ptr<program::ir::Function> build_first(std::string const &code, program::UnresolvedProgram *program) {
+  auto funcManager = api::ExternalFunctionManager();
+  if (!Scanner(program, &funcManager).Scan(code)) return nullptr;
+  return program::ir::Build(program->function_declarations.front(), program->root.num_variable_declarations,
+                            [](program::FunctionDeclaration const &, program::ir::Callee *) { return false; });
+}
+}  // namespace
+
 TEST(ScannerTest, getNextWord) {
   auto program = program::UnresolvedProgram();
   auto funcManager = api::ExternalFunctionManager();
@@ -61,4 +147,466 @@ TEST(ScannerTest, getNextWord) {
   EXPECT_EQ(type, Scanner::WordType::Bracket);
 }
 
+TEST(ScannerTest, splitsCallArguments) {
+  auto program = program::UnresolvedProgram();
+  auto funcManager = api::ExternalFunctionManager();
+  Scanner scanner = Scanner(&program, &funcManager);
+
+  // The locations of the statements require two lines in front of them
+  ASSERT_TRUE(scanner.Scan("\n\n"
+                           "int sub(int a, int b) { return a - b; }\n"
+                           "int main() { return sub(10, sub(5, 2)); }"));
+  ASSERT_EQ(program.function_declarations.size(), 2u);
+
+  // The caller pushes the arguments in order, so the parameters get popped in reverse order
+  auto const &sub = program.function_declarations.front().definition.statements;
+  ASSERT_GE(sub.size(), 2u);
+  EXPECT_EQ(dynamic_cast<token::Label const *>(sub.front().arguments.front().value)->label_string, "b");
+  EXPECT_EQ(dynamic_cast<token::Label const *>(std::next(sub.begin())->arguments.front().value)->label_string, "a");
+
+  // The comma of the nested call does not split the arguments
+  program::Statement const *call = nullptr;
+  for (auto const &statement : program.function_declarations.back().definition.statements) {
+    if (call == nullptr) call = find_call(statement, "sub");
+  }
+  ASSERT_NE(call, nullptr);
+  ASSERT_EQ(call->arguments.size(), 2u);
+  EXPECT_EQ(dynamic_cast<token::ConstantInt const *>(call->arguments.front().value)->value, 10);
+  auto nested = find_call(call->arguments.back(), "sub");
+  ASSERT_EQ(nested, &call->arguments.back());
+  EXPECT_EQ(nested->arguments.size(), 2u);
+}
+
+TEST(CompilerTest, returnLeavesFunction) {
+  const std::string filename = testing::TempDir() + "return.chl";
+  // Without the return statements falling through, sub(10, 3) * 2 + early(1) is 19
+  std::ofstream(filename) << "\n\n"
+                             "int sub(int a, int b) { return a - b; }\n"
+                             "int early(int a) { if (a) { return 5; } return 9; }\n"
+                             "int main() { int x = sub(10, 3); return x * 2 + early(1); }";
+  Compiler compiler;
+  ASSERT_TRUE(compiler.Build(filename, false));
+
+  vm::Runtime runtime(compiler.GetProgram());
+  EXPECT_EQ(runtime.Run(), 19);
+}
+
+TEST(ConstantFoldingTest, EvaluateRefusesTrappingDivisions) {
+  using vm::InstructionEnums;
+  int result = 0;
+  EXPECT_TRUE(program::Evaluate(InstructionEnums::IntDivide, 7, 2, &result));
+  EXPECT_EQ(result, 3);
+  EXPECT_TRUE(program::Evaluate(InstructionEnums::IntModulo, -7, 2, &result));
+  EXPECT_EQ(result, -1);
+
+  // These trap at runtime like in the VM
+  EXPECT_FALSE(program::Evaluate(InstructionEnums::IntDivide, 7, 0, &result));
+  EXPECT_FALSE(program::Evaluate(InstructionEnums::IntModulo, 7, 0, &result));
+  EXPECT_FALSE(program::Evaluate(InstructionEnums::IntDivide, INT_MIN, -1, &result));
+  EXPECT_FALSE(program::Evaluate(InstructionEnums::IntModulo, INT_MIN, -1, &result));
+}
+
+TEST(ConstantFoldingTest, KeepsDivisionByZero) {
+  auto funcManager = api::ExternalFunctionManager();
+
+  auto folded = program::UnresolvedProgram();
+  ASSERT_TRUE(Scanner(&folded, &funcManager).Scan("\n\nint main() { return 4 - 1; }"));
+  EXPECT_EQ(program::FoldConstants(&folded), 1);
+
+  auto kept = program::UnresolvedProgram();
+  ASSERT_TRUE(Scanner(&kept, &funcManager).Scan("\n\nint main() { return 4 / 0; }"));
+  EXPECT_EQ(program::FoldConstants(&kept), 0);
+}
+
+TEST(IrTest, HoistLoopInvariants) {
+  auto program = program::UnresolvedProgram();
+  auto function = build_first(kLoop, &program);
+  ASSERT_NE(function, nullptr);
+  int inside, outside;
+  count_multiplications(*function, &inside, &outside);
+  EXPECT_EQ(inside, 2);
+  EXPECT_EQ(outside, 0);
+
+  program::ir::PassManager passes;
+  passes.Add(program::ir::CreateSimplifyPhis());
+  passes.Add(program::ir::CreateHoistLoopInvariants());
+  passes.Add(program::ir::CreateEliminateDeadCode());
+  passes.Run(function.get());
+
+  // n * 4 gets calculated once in front of the loop
+  count_multiplications(*function, &inside, &outside);
+  EXPECT_EQ(inside, 1);
+  EXPECT_EQ(outside, 1);
+}
+
+TEST(IrTest, ReduceStrength) {
+  auto program = program::UnresolvedProgram();
+  auto function = build_first(kLoop, &program);
+  ASSERT_NE(function, nullptr);
+
+  program::ir::PassManager::Default().Run(function.get());
+
+  // i * k becomes an induction variable of its own, which gets increased by k
+  int inside, outside;
+  count_multiplications(*function, &inside, &outside);
+  EXPECT_EQ(inside, 0);
+  EXPECT_EQ(outside, 1);
+}
+
+TEST(CompilerTest, exitValueDoesNotDependOnBackend) {
+  const std::string filename = testing::TempDir() + "unused.chl";
+  // The value of bump(k) is unused. Falling off the end of main returns 0.
+  for (auto const &tail : {std::make_pair("", 0), std::make_pair(" return k;", 11)}) {
+    std::ofstream(filename) << "\n\n"
+                               "int g = 0;\n"
+                               "int bump(int v) { g = g + v; return g; }\n"
+                               "int main() { int k = 11; bump(k);"
+                            << tail.first << " }";
+    // SSA form, syntax tree with and without register instructions
+    for (int backend = 0; backend < 3; ++backend) {
+      Compiler compiler;
+      compiler.options.ssa = backend == 0;
+      compiler.options.register_instructions = backend < 2;
+      ASSERT_TRUE(compiler.Build(filename, false));
+      for (auto engine : {vm::Runtime::Engine::Switch, vm::Runtime::Engine::Table, vm::Runtime::Engine::Jit}) {
+        vm::Runtime runtime(compiler.GetProgram());
+        EXPECT_EQ(runtime.Run(engine), tail.second)
+            << "backend: " << backend << " engine: " << static_cast<int>(engine);
+      }
+    }
+  }
+}
+
+TEST(CompilerTest, loopOptimizationsKeepResult) {
+  const std::string filename = testing::TempDir() + "loop.chl";
+  std::ofstream(filename) << kLoop;
+  for (bool ssa : {true, false}) {
+    Compiler compiler;
+    compiler.options.ssa = ssa;
+    ASSERT_TRUE(compiler.Build(filename, false));
+    vm::Runtime runtime(compiler.GetProgram());
+    EXPECT_EQ(runtime.Run(), 3 * 45 + 10 * 40) << "ssa: " << ssa;
+  }
+}
+
+TEST(CompilerTest, parallelCompileMatchesOneJob) {
+  const std::string filename = testing::TempDir() + "chain.chl";
+  {
+    // Each function calls the previous one. The odd ones write a global variable and can not be evaluated.
+    std::ofstream source(filename);
+    source << "\n\nint g = 0;\nint f0(int v) { return v * 2; }\n";
+    for (int i = 1; i < 40; ++i) {
+      source << "int f" << i << "(int v) { ";
+      if (i % 2 == 1) {
+        source << "g = g + v; return f" << i - 1 << "(v) + " << i << "; }\n";
+      } else {
+        source << "int s = v * 3; while (s > 10) { s = s - 7; } return f" << i - 1 << "(s) + g; }\n";
+      }
+    }
+    source << "int main() { return f39(5); }";
+  }
+  for (bool ssa : {true, false}) {
+    for (int evaluation_budget : {0, 1 << 16}) {
+      std::vector<int> expected;
+      for (int threads : {1, 2, 8}) {
+        Compiler compiler;
+        compiler.options.ssa = ssa;
+        compiler.options.evaluation_budget = evaluation_budget;
+        compiler.options.threads = threads;
+        ASSERT_TRUE(compiler.Build(filename, false));
+        auto program = compiler.CreateProgram();
+        ASSERT_NE(program, nullptr);
+        if (threads == 1) expected = program->bytecode;
+        EXPECT_EQ(program->bytecode, expected)
+            << "ssa: " << ssa << " evaluation budget: " << evaluation_budget << " threads: " << threads;
+      }
+    }
+  }
+}
+
+TEST(CompilerTest, evaluatesPureCallsAtBuildTime) {
+  const std::string filename = testing::TempDir() + "pure.chl";
+  // cubic is pure, bump writes a global variable
+  std::ofstream(filename) << "\n\n"
+                             "int g = 0;\n"
+                             "int cubic(int v) { return v * v * v; }\n"
+                             "int bump(int v) { g = g + v; return g; }\n"
+                             "int main() { return cubic(3) + bump(1); }";
+  int calls[2];
+  for (int evaluate = 0; evaluate < 2; ++evaluate) {
+    Compiler compiler;
+    compiler.options.inline_size = 0;
+    compiler.options.evaluation_budget = evaluate ? 1 << 16 : 0;
+    ASSERT_TRUE(compiler.Build(filename, false));
+    auto program = compiler.CreateProgram();
+    calls[evaluate] = count_calls(program->bytecode);
+    vm::Runtime runtime(std::make_unique<vm::State>(program));
+    EXPECT_EQ(runtime.Run(), 28) << "evaluate: " << evaluate;
+  }
+  // Only the call of cubic is gone
+  EXPECT_EQ(calls[1], calls[0] - 1);
+}
+
+TEST(CompilerTest, jitMatchesSwitchEngine) {
+  const std::string sample = std::string(__FILE__).substr(0, std::string(__FILE__).find_last_of("/\\") + 1) +
+                             "../samples/simple.chl";
+  const std::string loop = testing::TempDir() + "jit_loop.chl";
+  std::ofstream(loop) << kLoop;
+  const std::string recursion = testing::TempDir() + "jit_fib.chl";
+  std::ofstream(recursion) << "\n\n"
+                              "int fib(int n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }\n"
+                              "int main() { println(fib(15)); return fib(20) % 1000; }";
+  for (auto const &filename : {sample, loop, recursion}) {
+    for (bool ssa : {true, false}) {
+      std::vector<int> printed;
+      Compiler compiler;
+      compiler.options.ssa = ssa;
+      compiler.external_function_manager.AddFunction("println", [&printed](int value) { printed.push_back(value); });
+      ASSERT_TRUE(compiler.Build(filename, false)) << filename;
+      auto program = compiler.CreateProgram();
+
+      vm::Runtime interpreted(std::make_unique<vm::State>(program));
+      const int expected = interpreted.Run(vm::Runtime::Engine::Switch);
+      const auto expected_printed = printed;
+      printed.clear();
+      vm::Runtime compiled(std::make_unique<vm::State>(program));
+      EXPECT_EQ(compiled.Run(vm::Runtime::Engine::Jit), expected) << filename << " ssa: " << ssa;
+      EXPECT_EQ(printed, expected_printed) << filename << " ssa: " << ssa;
+    }
+  }
+}
+
+TEST(RuntimeTest, HaltsOnTrappingDivisions) {
+  const std::string filename = testing::TempDir() + "divide.chl";
+  for (const char *const divide : {"a / b", "a % b"}) {
+    // Division by zero and of INT_MIN by -1
+    for (const char *const call : {"f(7, 0)", "f(0 - 2147483647 - 1, 0 - 1)"}) {
+      std::ofstream(filename) << "\n\nint f(int a, int b) { return " << divide << "; }\nint main() { return " << call
+                              << "; }";
+      for (bool ssa : {true, false}) {
+        Compiler compiler;
+        compiler.options.ssa = ssa;
+        ASSERT_TRUE(compiler.Build(filename, false));
+        for (auto engine : {vm::Runtime::Engine::Switch, vm::Runtime::Engine::Table, vm::Runtime::Engine::Jit}) {
+          vm::Runtime runtime(compiler.GetProgram());
+          runtime.Run(engine);
+          EXPECT_GT(runtime.GetState().pos, -1)
+              << divide << " " << call << " ssa: " << ssa << " engine: " << static_cast<int>(engine);
+        }
+      }
+    }
+  }
+}
+
+TEST(RuntimeTest, ChecksStackOfUnverifiedPrograms) {
+  using vm::InstructionEnums;
+  api::ExternalFunctionManager external_functions;
+  // Neither program opens the global scope, so they do not pass the verifier
+  auto underflow = std::make_shared<const vm::Program>(
+      std::vector<int>{InstructionEnums::PushConst, 1, InstructionEnums::IntAdd, InstructionEnums::Exit}, 2,
+      external_functions);
+  std::vector<int> pushes;
+  for (int i = 0; i < 1000; ++i) pushes.insert(pushes.end(), {InstructionEnums::PushConst, i});
+  pushes.push_back(InstructionEnums::Exit);
+  // Claims a depth which is too small
+  auto overflow = std::make_shared<const vm::Program>(pushes, 1, external_functions);
+  ASSERT_FALSE(underflow->IsVerified());
+  ASSERT_FALSE(overflow->IsVerified());
+
+  for (auto engine : {vm::Runtime::Engine::Switch, vm::Runtime::Engine::Jit}) {
+    vm::Runtime halted(std::make_unique<vm::State>(underflow));
+    halted.Run(engine);
+    EXPECT_EQ(halted.GetState().pos, 2) << "engine: " << static_cast<int>(engine);
+
+    vm::Runtime grown(std::make_unique<vm::State>(overflow));
+    EXPECT_EQ(grown.Run(engine), 999) << "engine: " << static_cast<int>(engine);
+    EXPECT_EQ(grown.GetState().alu_stack.size(), 1000u);
+  }
+}
+
+TEST(RuntimeTest, RunForResumesSuspendedProgram) {
+  const std::string filename = testing::TempDir() + "slices.chl";
+  std::ofstream(filename) << "\n\n"
+                             "int f(int n, int k) { int s = 0; int i = 0; while (i < n) { s = s + i * k + n * 4; "
+                             "i = i + 1; } return s; }\n"
+                             "int main() { return f(1000, 3); }";
+  Compiler compiler;
+  // Otherwise the call gets evaluated at build time
+  compiler.options.evaluation_budget = 0;
+  ASSERT_TRUE(compiler.Build(filename, false));
+  vm::Runtime runtime(compiler.GetProgram());
+  int slices = 1;
+  auto status = runtime.RunFor(100);
+  for (; status == vm::Runtime::Status::Suspended && slices < 1000000; ++slices) status = runtime.RunFor(100);
+  EXPECT_EQ(status, vm::Runtime::Status::Finished);
+  EXPECT_GT(slices, 10);
+  EXPECT_EQ(runtime.GetResult(), 3 * 499500 + 1000 * 4000);
+}
+
+TEST(StatePoolTest, ReusedStateStartsFromZero) {
+  const std::string filename = testing::TempDir() + "reuse.chl";
+  // Each run leaves values in the global and the local variable behind
+  std::ofstream(filename) << "\n\n"
+                             "int secret;\n"
+                             "int peek(int v) { int local; int r = local; local = v; return r; }\n"
+                             "int main() { int r = secret + peek(77); secret = 1234; return r; }";
+  for (bool ssa : {true, false}) {
+    Compiler compiler;
+    compiler.options.ssa = ssa;
+    ASSERT_TRUE(compiler.Build(filename, false));
+    vm::StatePool pool(compiler.CreateProgram());
+    for (int run = 0; run < 2; ++run) {
+      vm::Runtime runtime(pool.Acquire());
+      EXPECT_EQ(runtime.Run(), 0) << "ssa: " << ssa << " run: " << run;
+      pool.Release(runtime.ReleaseState());
+      EXPECT_EQ(pool.GetFreeCount(), 1u);
+    }
+  }
+}
+
+TEST(SchedulerTest, ResumesAllInstancesWaitingForOneResult) {
+  const std::string filename = testing::TempDir() + "parked.chl";
+  std::ofstream(filename) << "\n\nint main() { return lookup(1) + 1; }";
+  Compiler compiler;
+  // The host hands out the same result to all callers
+  auto shared = std::make_shared<api::PendingResult>();
+  std::atomic<int> calls(0);
+  compiler.external_function_manager.AddAsyncFunction("lookup", [&](int) {
+    ++calls;
+    return shared;
+  });
+  ASSERT_TRUE(compiler.Build(filename, false));
+  auto program = compiler.CreateProgram();
+
+  // One worker runs the instances one after the other. So the first two are parked once the third one called lookup.
+  vm::Scheduler scheduler(1);
+  std::vector<std::future<vm::Scheduler::Result>> futures;
+  for (int i = 0; i < 3; ++i) futures.push_back(scheduler.Submit(std::make_unique<vm::State>(program)));
+  while (calls < 3) std::this_thread::yield();
+  shared->Resolve(41);
+
+  for (auto &future : futures) {
+    ASSERT_EQ(future.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+    auto result = future.get();
+    EXPECT_EQ(result.status, vm::Runtime::Status::Finished);
+    EXPECT_EQ(result.value, 42);
+  }
+  scheduler.Wait();
+}
+
+TEST(PeepholeTest, FuseKeepsJumpTargets) {
+  using vm::InstructionEnums;
+  auto program = program::UnresolvedProgram();
+  // while (r0 < 10) r0 = r0 + r1;
+  program.instructions = {BYTECODE_VERSION,
+                          InstructionEnums::Push, 0,
+                          InstructionEnums::PushConst, 10,
+                          InstructionEnums::IntLess,
+                          InstructionEnums::JumpIfZero, 16,
+                          InstructionEnums::Push, 0,
+                          InstructionEnums::Push, 1,
+                          InstructionEnums::IntAdd,
+                          InstructionEnums::IntCopy, 0,
+                          InstructionEnums::Jump, 0,
+                          InstructionEnums::Exit};
+
+  EXPECT_EQ(program::FuseInstructions(&program, nullptr), 3);
+
+  // The loop still jumps back to the condition and leaves it to the Exit
+  std::vector<int> expected = {BYTECODE_VERSION,
+                               InstructionEnums::JumpIfIntGreaterEqualRI, 0, 10, 10,
+                               InstructionEnums::IntAddRRR, 0, 0, 1,
+                               InstructionEnums::Jump, 0,
+                               InstructionEnums::Exit};
+  EXPECT_EQ(program.instructions, expected);
+}
+
+TEST(PeepholeTest, KeepsSequenceContainingJumpTarget) {
+  using vm::InstructionEnums;
+  auto program = program::UnresolvedProgram();
+  program.instructions = {BYTECODE_VERSION,
+                          InstructionEnums::Push, 0,
+                          InstructionEnums::Push, 1,
+                          InstructionEnums::IntAdd,
+                          InstructionEnums::Jump, 2,
+                          InstructionEnums::Exit};
+  const auto original = program.instructions;
+
+  EXPECT_EQ(program::FuseInstructions(&program, nullptr), 0);
+  EXPECT_EQ(program.instructions, original);
+}
+
+TEST(DeadCodeTest, MovesTargetsAndMappingBehindRemovedFunctions) {
+  using vm::InstructionEnums;
+  auto program = program::UnresolvedProgram();
+  // f() and h() are not called, g() is
+  program.instructions = {BYTECODE_VERSION,
+                          InstructionEnums::Jump, 11,
+                          InstructionEnums::PushConst, 7,   // f
+                          InstructionEnums::Return,
+                          InstructionEnums::PushConst, 1,   // g
+                          InstructionEnums::Return,
+                          InstructionEnums::PushConst, 3,   // h
+                          InstructionEnums::Return,
+                          InstructionEnums::Call, 5,
+                          InstructionEnums::Jump, 15,
+                          InstructionEnums::Exit};
+  const std::vector<std::pair<int, int>> functions = {{2, 5}, {5, 8}, {8, 11}};
+  program::Mapping mapping;
+  for (auto const &name : {"f", "g", "h"}) {
+    mapping.Functions.push_back(std::make_unique<program::Mapping::Function>(name));
+  }
+  for (int i = 0; i < 3; ++i) {
+    mapping.Functions[i]->scope.begin = functions[i].first;
+    mapping.Functions[i]->scope.end = functions[i].second;
+    mapping.Scopes.push_back(std::make_unique<program::Mapping::Scope>());
+    mapping.Scopes.back()->begin = functions[i].first;
+    mapping.Scopes.back()->end = functions[i].second;
+  }
+  for (int address : {0, 2, 4, 5, 7, 8, 11, 13, 15}) {
+    mapping.Instructions[address] = program::Mapping::Location(address, 0);
+  }
+
+  EXPECT_EQ(program::RemoveUnusedFunctions(&program, functions, &mapping), 2);
+
+  std::vector<int> expected = {BYTECODE_VERSION,
+                               InstructionEnums::Jump, 5,
+                               InstructionEnums::PushConst, 1,
+                               InstructionEnums::Return,
+                               InstructionEnums::Call, 2,
+                               InstructionEnums::Jump, 9,
+                               InstructionEnums::Exit};
+  EXPECT_EQ(program.instructions, expected);
+
+  ASSERT_EQ(mapping.Functions.size(), 1u);
+  EXPECT_EQ(mapping.Functions[0]->name, "g");
+  EXPECT_EQ(mapping.Functions[0]->scope.begin, 2);
+  EXPECT_EQ(mapping.Functions[0]->scope.end, 5);
+  ASSERT_EQ(mapping.Scopes.size(), 1u);
+  EXPECT_EQ(mapping.Scopes[0]->begin, 2);
+  EXPECT_EQ(mapping.Scopes[0]->end, 5);
+  // Each kept instruction keeps its source location
+  std::map<int, int> lines;
+  for (auto const &location : mapping.Instructions) lines[location.first] = location.second.line;
+  std::map<int, int> expected_lines = {{0, 0}, {2, 5}, {4, 7}, {5, 11}, {7, 13}, {9, 15}};
+  EXPECT_EQ(lines, expected_lines);
+}
+
+TEST(VerifierTest, RejectsRegisterOutOfRange) {
+  using vm::InstructionEnums;
+  // One global variable
+  vm::DecodedProgram valid;
+  ASSERT_TRUE(valid.Decode({InstructionEnums::IncreaseRegister, 1,
+                            InstructionEnums::MoveRI, 0, 5,
+                            InstructionEnums::Exit}));
+  int depth;
+  EXPECT_TRUE(vm::VerifyProgram(valid, nullptr, &depth));
+
+  vm::DecodedProgram invalid;
+  ASSERT_TRUE(invalid.Decode({InstructionEnums::IncreaseRegister, 1,
+                              InstructionEnums::MoveRI, 1, 5,
+                              InstructionEnums::Exit}));
+  EXPECT_FALSE(vm::VerifyProgram(invalid, nullptr, &depth));
+}
+
 }  // namespace charlie